@@ -23,11 +23,14 @@
 
 #include <inttypes.h>
 #include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <stdbool.h>
 #include <assert.h>
 
 #include "utils/log.h"
 #include "utils/utils.h"
+#include "utils/nsoption.h"
 #include "netsurf/bitmap.h"
 #include "netsurf/plotters.h"
 #include "netsurf/content.h"
@@ -35,82 +38,1174 @@
 #include <X11/Xlib.h>
 #include <X11/Intrinsic.h>
 #include <X11/extensions/shape.h>
+#include <X11/extensions/XShm.h>
 #include <Xm/DrawingA.h>
 #include <stdlib.h>
 
 #include "motif/gui.h"
 #include "motif/drawing.h"
 #include "motif/bitmap.h"
+#include "motif/swizzle.h"
+#include "motif/threadpool.h"
+#include "motif/schedule.h"
+#include "motif/residency.h"
 
 extern Display *motifDisplay;
 extern Visual *motifVisual;
 extern Widget motifWindow;
+extern int motifDepth;
+
+/* bitmaps with at least this many pixels are converted in parallel bands */
+#define BITMAP_PARALLEL_PIXELS (512 * 512)
+
+/* pixels converted by each band */
+#define BITMAP_BAND_PIXELS (128 * 1024)
+
+/* destroyed bitmaps released by each pass of the idle task */
+#define BITMAP_RELEASE_CHUNK 8
+
+/* count word of a packed run of one repeated pixel */
+#define BITMAP_PACK_REPEAT 0x80000000u
+
+/* longest packed run */
+#define BITMAP_PACK_RUN_MAX 0x7fffffffu
+
+/**
+ * Destroyed bitmap waiting to be released.
+ */
+struct bitmap_dead {
+	struct bitmap_dead *next;
+	MotifBitmap *bmp;
+};
+
+static struct bitmap_dead *bitmap_dead_list = NULL;
+
+/**
+ * Copy of a bitmap scaled to the size it is plotted at.
+ */
+struct bitmap_scaled {
+	struct bitmap_scaled *next; /**< next size of the same bitmap */
+	struct bitmap_scaled *lru_prev; /**< more recently used */
+	struct bitmap_scaled *lru_next; /**< less recently used */
+	MotifBitmap *bmp;
+	int width, height;
+	Pixmap pixmap;
+	Pixmap mask; /**< None when every pixel is drawn */
+	size_t size; /**< server memory used */
+};
+
+static struct bitmap_scaled *bitmap_scaled_head = NULL;
+static struct bitmap_scaled *bitmap_scaled_tail = NULL;
+
+/* bytes of scaled copies held across every bitmap */
+static size_t bitmap_scaled_bytes = 0;
+
+/* smallest fill tile side, smaller bitmaps are repeated to reach it */
+#define BITMAP_TILE_MIN 64
+
+#ifndef NSMOTIF_USE_GL
+/* bitmaps with at least this many pixels are shared with the server */
+#define BITMAP_SHM_PIXELS (128 * 128)
+
+/* largest segment kept for uploading scaled copies */
+#define BITMAP_SHM_SCRATCH_MAX (4 * 1024 * 1024)
+
+/**
+ * Shared memory segment pixel data is uploaded from.
+ */
+struct bitmap_shm {
+	XShmSegmentInfo info;
+	size_t size;
+	bool pending; /**< an upload from the segment has not completed */
+	struct bitmap_shm *next; /**< next segment with an upload pending */
+};
+
+/* whether MIT-SHM is used, -1 until first checked */
+static int bitmap_shm_state = -1;
+
+/* event type of upload completions */
+static int bitmap_shm_completion;
+
+/* segments with an upload pending */
+static struct bitmap_shm *bitmap_shm_pending = NULL;
+
+/* segment scaled copies are uploaded from */
+static struct bitmap_shm bitmap_shm_scratch;
+
+/* set by the error handler while attaching */
+static bool bitmap_shm_failed;
+
+/**
+ * Mark the upload from a segment complete.
+ */
+static Boolean bitmap_shm_dispatch(XEvent *event)
+{
+	XShmCompletionEvent *completion = (XShmCompletionEvent *)event;
+	struct bitmap_shm **link = &bitmap_shm_pending;
+
+	while(*link != NULL) {
+		if((*link)->info.shmseg == completion->shmseg) {
+			struct bitmap_shm *shm = *link;
+			*link = shm->next;
+			shm->next = NULL;
+			shm->pending = false;
+			break;
+		}
+		link = &(*link)->next;
+	}
+
+	return True;
+}
+
+/**
+ * Check whether uploads can go through MIT-SHM.
+ */
+static bool bitmap_shm_available(void)
+{
+	if(bitmap_shm_state < 0) {
+		bitmap_shm_state = 0;
+		if(nsoption_bool(motif_shm_upload) && XShmQueryExtension(motifDisplay)) {
+			bitmap_shm_completion = XShmGetEventBase(motifDisplay) + ShmCompletion;
+			XtSetEventDispatcher(motifDisplay, bitmap_shm_completion, bitmap_shm_dispatch);
+			bitmap_shm_state = 1;
+		}
+		NSLOG(netsurf, INFO, "MIT-SHM uploads %s", bitmap_shm_state ? "enabled" : "disabled");
+	}
+
+	return bitmap_shm_state == 1;
+}
+
+static int bitmap_shm_error(Display *display, XErrorEvent *error)
+{
+	bitmap_shm_failed = true;
+	return 0;
+}
+
+/**
+ * Create a segment and attach it to the server.
+ *
+ * \return true on success.
+ */
+static bool bitmap_shm_alloc(struct bitmap_shm *shm, size_t size)
+{
+	int (*handler)(Display *, XErrorEvent *);
+
+	shm->info.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+	if(shm->info.shmid < 0) {
+		return false;
+	}
+	shm->info.shmaddr = shmat(shm->info.shmid, NULL, 0);
+	if(shm->info.shmaddr == (char *)-1) {
+		shmctl(shm->info.shmid, IPC_RMID, NULL);
+		shm->info.shmaddr = NULL;
+		return false;
+	}
+	shm->info.readOnly = True;
+
+	// A server on another machine cannot attach
+	bitmap_shm_failed = false;
+	XSync(motifDisplay, False);
+	handler = XSetErrorHandler(bitmap_shm_error);
+	XShmAttach(motifDisplay, &shm->info);
+	XSync(motifDisplay, False);
+	XSetErrorHandler(handler);
+
+	// The segment goes away once both sides have detached
+	shmctl(shm->info.shmid, IPC_RMID, NULL);
+
+	if(bitmap_shm_failed) {
+		NSLOG(netsurf, INFO, "MIT-SHM attach failed, using XPutImage");
+		bitmap_shm_state = 0;
+		shmdt(shm->info.shmaddr);
+		shm->info.shmaddr = NULL;
+		return false;
+	}
+
+	shm->size = size;
+	shm->pending = false;
+	shm->next = NULL;
+	return true;
+}
+
+static Bool bitmap_shm_match(Display *display, XEvent *event, XPointer arg)
+{
+	struct bitmap_shm *shm = (struct bitmap_shm *)arg;
+
+	return (event->type == bitmap_shm_completion) &&
+		(((XShmCompletionEvent *)event)->shmseg == shm->info.shmseg);
+}
+
+/**
+ * Wait for an upload from a segment to complete before it is written.
+ */
+static void bitmap_shm_wait(struct bitmap_shm *shm)
+{
+	XEvent event;
+
+	if(shm->pending) {
+		XIfEvent(motifDisplay, &event, bitmap_shm_match, (XPointer)shm);
+		bitmap_shm_dispatch(&event);
+	}
+}
+
+/**
+ * Detach and free a segment.
+ */
+static void bitmap_shm_free(struct bitmap_shm *shm)
+{
+	if(shm->info.shmaddr == NULL) {
+		return;
+	}
+
+	bitmap_shm_wait(shm);
+	XShmDetach(motifDisplay, &shm->info);
+	shmdt(shm->info.shmaddr);
+	shm->info.shmaddr = NULL;
+	shm->size = 0;
+}
+
+/**
+ * Create an image whose pixel data is held in a segment.
+ *
+ * \return The image or NULL if the segment can not hold it.
+ */
+static XImage *bitmap_shm_image(struct bitmap_shm *shm, int width, int height)
+{
+	XImage *image;
+
+	image = XShmCreateImage(motifDisplay, motifVisual, 24, ZPixmap, NULL, &shm->info, width, height);
+	if(image == NULL) {
+		return NULL;
+	}
+	if((image->bytes_per_line != width * 4) || (shm->size < (size_t)(width * height * 4))) {
+		XDestroyImage(image);
+		return NULL;
+	}
+
+	image->data = shm->info.shmaddr;
+	return image;
+}
+
+/**
+ * Free an image created by bitmap_shm_image(), leaving its segment.
+ */
+static void bitmap_shm_image_destroy(XImage *image)
+{
+	image->data = NULL;
+	XDestroyImage(image);
+}
+
+/**
+ * Upload an image held in a segment, completing asynchronously.
+ */
+static void bitmap_shm_put(struct bitmap_shm *shm, Drawable drawable, GC gc, XImage *image, int width, int height)
+{
+	bitmap_shm_wait(shm);
+
+	XShmPutImage(motifDisplay, drawable, gc, image, 0, 0, 0, 0, width, height, True);
+	shm->pending = true;
+	shm->next = bitmap_shm_pending;
+	bitmap_shm_pending = shm;
+}
+
+/**
+ * Create the image of a new bitmap in its own segment.
+ *
+ * \return The image or NULL to use a malloced buffer.
+ */
+static XImage *bitmap_shm_create(MotifBitmap *bmp)
+{
+	struct bitmap_shm *shm;
+	XImage *image;
+
+	if(((bmp->width * bmp->height) < BITMAP_SHM_PIXELS) || !bitmap_shm_available()) {
+		return NULL;
+	}
+
+	shm = calloc(1, sizeof(struct bitmap_shm));
+	if(shm == NULL) {
+		return NULL;
+	}
+	if(!bitmap_shm_alloc(shm, bmp->width * bmp->height * 4)) {
+		free(shm);
+		return NULL;
+	}
+
+	image = bitmap_shm_image(shm, bmp->width, bmp->height);
+	if(image == NULL) {
+		bitmap_shm_free(shm);
+		free(shm);
+		return NULL;
+	}
+
+	bmp->shm = shm;
+	bmp->buffer = image->data;
+	return image;
+}
+
+/**
+ * Get an image for a scaled copy held in the scratch segment.
+ *
+ * \return The image or NULL to use a malloced buffer.
+ */
+static XImage *bitmap_shm_scratch_image(int width, int height)
+{
+	size_t size = width * height * 4;
+
+	if(((width * height) < BITMAP_SHM_PIXELS) || (size > BITMAP_SHM_SCRATCH_MAX) ||
+	   !bitmap_shm_available()) {
+		return NULL;
+	}
+
+	bitmap_shm_wait(&bitmap_shm_scratch);
+	if(bitmap_shm_scratch.size < size) {
+		bitmap_shm_free(&bitmap_shm_scratch);
+		if(!bitmap_shm_alloc(&bitmap_shm_scratch, size)) {
+			return NULL;
+		}
+	}
+
+	return bitmap_shm_image(&bitmap_shm_scratch, width, height);
+}
+#endif
+
+/**
+ * Conversion of the pixel data of a bitmap into server order.
+ */
+struct bitmap_conversion {
+	MotifBitmap *bmp;
+	int opaque; /**< opacity of the bitmap when converted */
+	char *maskBuffer; /**< 1 bit mask built for non opaque bitmaps */
+	int hasMask; /**< mask has transparent pixels */
+	int hasAlpha; /**< some pixels are not fully opaque */
+	unsigned int flags; /**< MOTIF_SWIZZLE_ flags, updated atomically */
+};
+
+/**
+ * Rows of a bitmap converted by one job.
+ */
+struct bitmap_band {
+	struct bitmap_conversion *conv;
+	int y; /**< first row */
+	int rows;
+};
+
+static bool bitmap_demote(void *pw, enum motif_tier tier);
+
+/**
+ * Record the bytes a bitmap holds in each tier.
+ */
+static void bitmap_account(MotifBitmap *bmp)
+{
+	size_t pixels = bmp->width * bmp->height * 4;
+	size_t client = 0;
+	size_t server = 0;
+
+	if(bmp->buffer != NULL) {
+		client = pixels;
+	} else if(bmp->packed != NULL) {
+		client = bmp->packedSize;
+	}
+
+	if(bmp->pixmap != None) {
+		server += pixels;
+	}
+	if(bmp->mask != None) {
+		server += ((bmp->width+7)>>3) * bmp->height;
+	}
+	if((bmp->tile != None) && (bmp->tile != bmp->pixmap)) {
+		server += bmp->tileWidth * bmp->tileHeight * 4;
+	}
+#ifndef NSMOTIF_USE_GL
+	if(bmp->argb != None) {
+		server += pixels;
+	}
+#endif
+
+	motif_resident_set(&bmp->resident, MOTIF_TIER_CLIENT, client);
+	motif_resident_set(&bmp->resident, MOTIF_TIER_SERVER, server);
+}
+
+/**
+ * Allocate the client side buffer of a bitmap.
+ *
+ * \return true on success.
+ */
+static bool bitmap_client_alloc(MotifBitmap *bmp)
+{
+#ifndef NSMOTIF_USE_GL
+	// Large bitmaps are uploaded straight from memory shared with the server
+	bmp->ximage = bitmap_shm_create(bmp);
+	if(bmp->ximage != NULL) {
+		return true;
+	}
+#endif
+	bmp->buffer = (char *)malloc(bmp->width*bmp->height*4);
+	if(bmp->buffer == NULL) {
+		return false;
+	}
+#ifndef NSMOTIF_USE_GL
+	bmp->ximage = XCreateImage(motifDisplay, motifVisual, 24, ZPixmap, 0, bmp->buffer, bmp->width, bmp->height, 32, bmp->width*4);
+#endif
+	return true;
+}
+
+/**
+ * Free the client side buffer of a bitmap.
+ */
+static void bitmap_client_free(MotifBitmap *bmp)
+{
+#ifndef NSMOTIF_USE_GL
+	if(bmp->shm != NULL) {
+		bitmap_shm_free(bmp->shm);
+		free(bmp->shm);
+		bmp->shm = NULL;
+		bitmap_shm_image_destroy(bmp->ximage);
+	} else if(bmp->ximage != NULL) {
+		//XDestroyImage frees the buffer too
+		XDestroyImage(bmp->ximage);
+	}
+	bmp->ximage = NULL;
+#else
+	free(bmp->buffer);
+#endif
+	bmp->buffer = NULL;
+}
+
+#ifndef NSMOTIF_USE_GL
+/**
+ * Run length encode the pixels of a bitmap.
+ *
+ * Each run starts with a count word. When BITMAP_PACK_REPEAT is set in
+ * it one pixel follows that is repeated count times, otherwise count
+ * pixels follow as they are.
+ *
+ * \param src The pixels.
+ * \param count Number of pixels.
+ * \param size Updated with the size of the packed pixels in bytes.
+ * \return The packed pixels or NULL if they would not save a quarter.
+ */
+static unsigned int *bitmap_pack(const unsigned int *src, size_t count, size_t *size)
+{
+	size_t limit = (count * 3) / 4;
+	unsigned int *packed;
+	unsigned int *shrunk;
+	size_t out = 0;
+	size_t i = 0;
+
+	packed = (unsigned int *)malloc(limit * 4);
+	if(packed == NULL) {
+		return NULL;
+	}
+
+	while(i < count) {
+		size_t run = 1;
+
+		while((i + run < count) && (src[i + run] == src[i]) && (run < BITMAP_PACK_RUN_MAX)) {
+			run++;
+		}
+
+		if(run >= 3) {
+			if(out + 2 > limit) {
+				free(packed);
+				return NULL;
+			}
+			packed[out++] = BITMAP_PACK_REPEAT | run;
+			packed[out++] = src[i];
+			i += run;
+		} else {
+			// Literal pixels up to the next run worth repeating
+			size_t start = i;
+
+			while((i < count) && ((i - start) < BITMAP_PACK_RUN_MAX) &&
+			      !((i + 2 < count) && (src[i] == src[i + 1]) && (src[i] == src[i + 2]))) {
+				i++;
+			}
+			if(out + 1 + (i - start) > limit) {
+				free(packed);
+				return NULL;
+			}
+			packed[out++] = i - start;
+			memcpy(&packed[out], &src[start], (i - start) * 4);
+			out += i - start;
+		}
+	}
+
+	shrunk = (unsigned int *)realloc(packed, out * 4);
+	if(shrunk != NULL) {
+		packed = shrunk;
+	}
+	*size = out * 4;
+	return packed;
+}
+
+/**
+ * Expand pixels packed by bitmap_pack().
+ */
+static void bitmap_unpack(const unsigned int *packed, unsigned int *dest, size_t count)
+{
+	size_t i = 0;
+
+	while(i < count) {
+		unsigned int word = *packed++;
+		unsigned int run = word & ~BITMAP_PACK_REPEAT;
+
+		if(word & BITMAP_PACK_REPEAT) {
+			unsigned int pixel = *packed++;
+			while(run-- > 0) {
+				dest[i++] = pixel;
+			}
+		} else {
+			memcpy(&dest[i], packed, run * 4);
+			packed += run;
+			i += run;
+		}
+	}
+}
+#endif
+
+/**
+ * Expand the client side buffer of a bitmap if it was demoted.
+ *
+ * \return true if the buffer is present.
+ */
+static bool bitmap_client_promote(MotifBitmap *bmp)
+{
+#ifndef NSMOTIF_USE_GL
+	if(bmp->packed != NULL) {
+		if(!bitmap_client_alloc(bmp)) {
+			return false;
+		}
+		bitmap_unpack(bmp->packed, (unsigned int *)bmp->buffer, bmp->width * bmp->height);
+		free(bmp->packed);
+		bmp->packed = NULL;
+		bitmap_account(bmp);
+	}
+#endif
+	return bmp->buffer != NULL;
+}
+
+/**
+ * Create a bitmap.
+ *
+ * \param  width   width of image in pixels
+ * \param  height  width of image in pixels
+ * \param  state   a flag word indicating the initial state
+ * \return an opaque struct bitmap, or NULL on memory exhaustion
+ */
+static void *bitmap_create(int width, int height, unsigned int state)
+{
+//printf("bitmap_create %dx%d %d\n", width, height, state);
+	MotifBitmap * bmp = (MotifBitmap *)malloc(sizeof(MotifBitmap));
+	if(!bmp) return NULL;
+
+	bmp->width = width;
+	bmp->height = height;
+	bmp->bpp = 4;
+	bmp->stride = width*4;
+	bmp->opaque = state & BITMAP_OPAQUE ? 1 : 0;
+	bmp->shm = NULL;
+	bmp->ximage = NULL;
+	bmp->buffer = NULL;
+	if(!bitmap_client_alloc(bmp)) {
+		free(bmp);
+		return NULL;
+	}
+	memset(bmp->buffer, 0, width*height*4);
+	bmp->packed = NULL;
+	bmp->packFailed = false;
+	bmp->pixmapFailed = false;
+
+	// The pixmap is created when the bitmap is first plotted
+	bmp->pixmap = None;
+	bmp->gc = NULL;
+	bmp->mask = None;
+	bmp->hasMask = 0;
+	bmp->dirty = true; // the buffer holds RGBA until first converted
+	bmp->alphaFlags = -1;
+	bmp->scaled = NULL;
+	bmp->tile = None;
+#ifndef NSMOTIF_USE_GL
+	bmp->hasAlpha = 0;
+	bmp->argb = None;
+	bmp->picture = None;
+#endif
+	motif_resident_add(&bmp->resident, bitmap_demote, bmp);
+	bitmap_account(bmp);
+	return bmp;
+}
+
+
+/**
+ * Return a pointer to the pixel data in a bitmap.
+ *
+ * \param  bitmap  a bitmap, as returned by bitmap_create()
+ * \return pointer to the pixel buffer
+ *
+ * The pixel data is packed as BITMAP_FORMAT, possibly with padding at the end
+ * of rows. The width of a row in bytes is given by bitmap_get_rowstride().
+ */
+static unsigned char *bitmap_get_buffer(void *bitmap)
+{
+	MotifBitmap * bmp = (MotifBitmap *)bitmap;
+	if(!bitmap_client_promote(bmp)) {
+		return NULL;
+	}
+	// The caller may write to the buffer
+	bmp->alphaFlags = -1;
+#ifndef NSMOTIF_USE_GL
+	// the server must be done reading it
+	if(bmp->shm != NULL) {
+		bitmap_shm_wait(bmp->shm);
+	}
+#endif
+	return (unsigned char *)bmp->buffer;
+}
+
+
+/**
+ * Find the width of a pixel row in bytes.
+ *
+ * \param  bitmap  a bitmap, as returned by bitmap_create()
+ * \return width of a pixel row in the bitmap
+ */
+static size_t bitmap_get_rowstride(void *bitmap)
+{
+	MotifBitmap * bmp = (MotifBitmap *)bitmap;
+	return bmp->stride;	
+}
+
+
+static void bitmap_scaled_unlink(struct bitmap_scaled *scaled)
+{
+	if(scaled->lru_prev != NULL) {
+		scaled->lru_prev->lru_next = scaled->lru_next;
+	} else {
+		bitmap_scaled_head = scaled->lru_next;
+	}
+	if(scaled->lru_next != NULL) {
+		scaled->lru_next->lru_prev = scaled->lru_prev;
+	} else {
+		bitmap_scaled_tail = scaled->lru_prev;
+	}
+	scaled->lru_prev = scaled->lru_next = NULL;
+}
+
+static void bitmap_scaled_push(struct bitmap_scaled *scaled)
+{
+	scaled->lru_prev = NULL;
+	scaled->lru_next = bitmap_scaled_head;
+	if(bitmap_scaled_head != NULL) {
+		bitmap_scaled_head->lru_prev = scaled;
+	} else {
+		bitmap_scaled_tail = scaled;
+	}
+	bitmap_scaled_head = scaled;
+}
+
+/**
+ * Free a scaled copy, removing it from its bitmap and the LRU list.
+ */
+static void bitmap_scaled_free(struct bitmap_scaled *scaled)
+{
+	struct bitmap_scaled **link = &scaled->bmp->scaled;
+
+	while(*link != scaled) {
+		link = &(*link)->next;
+	}
+	*link = scaled->next;
+
+	bitmap_scaled_unlink(scaled);
+	XFreePixmap(motifDisplay, scaled->pixmap);
+	if(scaled->mask != None) {
+		XFreePixmap(motifDisplay, scaled->mask);
+	}
+	bitmap_scaled_bytes -= scaled->size;
+	free(scaled);
+}
+
+/**
+ * Free every scaled copy of a bitmap.
+ */
+static void bitmap_scaled_flush(MotifBitmap *bmp)
+{
+	while(bmp->scaled != NULL) {
+		bitmap_scaled_free(bmp->scaled);
+	}
+}
+
+/**
+ * Scale the pixel data of a bitmap into new server side copies.
+ *
+ * \return true on success.
+ */
+static bool bitmap_scale(MotifBitmap *bmp, struct bitmap_scaled *scaled)
+{
+	int width = scaled->width;
+	int height = scaled->height;
+	unsigned int *src;
+	unsigned int *dest;
+	char *maskBuffer = NULL;
+	XImage *ximage;
+	GC gc;
+
+	if(!bitmap_client_promote(bmp)) {
+		return false;
+	}
+	src = (unsigned int *)bmp->buffer;
+
+	ximage = NULL;
+#ifndef NSMOTIF_USE_GL
+	ximage = bitmap_shm_scratch_image(width, height);
+#endif
+	if(ximage != NULL) {
+		dest = (unsigned int *)ximage->data;
+	} else {
+		dest = (unsigned int *)malloc(width*height*4);
+		if(dest == NULL) {
+			return false;
+		}
+	}
+	if(bmp->hasMask) {
+		maskBuffer = (char *)malloc(((width+7)>>3)*height);
+		if(maskBuffer == NULL) {
+#ifndef NSMOTIF_USE_GL
+			if(ximage != NULL) {
+				bitmap_shm_image_destroy(ximage);
+				return false;
+			}
+#endif
+			free(dest);
+			return false;
+		}
+	}
+
+	int i = 0;
+
+	for(int y = 0; y < height; y++) {
+		unsigned int *row = src + (((y * bmp->height) / height) * bmp->width);
+
+		for(int x = 0; x < width; x++) {
+			dest[i++] = row[(x * bmp->width) / width];
+		}
+	}
+
+	if(maskBuffer != NULL) {
+		motif_swizzle_mask(dest, width, height, (uint8_t *)maskBuffer);
+		scaled->mask = XCreatePixmapFromBitmapData(motifDisplay, XtWindow(motifWindow), maskBuffer, width, height, 1, 0, 1);
+		free(maskBuffer);
+	}
+
+	scaled->pixmap = XCreatePixmap(motifDisplay, XtWindow(motifWindow), width, height, motifDepth < 24 ? motifDepth : 24);
+	gc = XCreateGC(motifDisplay, scaled->pixmap, 0, 0);
+#ifndef NSMOTIF_USE_GL
+	if(ximage != NULL) {
+		bitmap_shm_put(&bitmap_shm_scratch, scaled->pixmap, gc, ximage, width, height);
+		bitmap_shm_image_destroy(ximage);
+	} else
+#endif
+	{
+		ximage = XCreateImage(motifDisplay, motifVisual, 24, ZPixmap, 0, (char *)dest, width, height, 32, width*4);
+		XPutImage(motifDisplay, scaled->pixmap, gc, ximage, 0, 0, 0, 0, width, height);
+		XDestroyImage(ximage);
+	}
+	XFreeGC(motifDisplay, gc);
+
+	scaled->size = (width * height * 4) + (((width+7)>>3) * height);
+	return true;
+}
+
+/* exported function documented in motif/bitmap.h */
+Pixmap bitmap_get_scaled(MotifBitmap *bmp, int width, int height, Pixmap *mask)
+{
+	struct bitmap_scaled *scaled;
+	size_t budget;
+	int kb;
+
+	*mask = None;
+	if((width <= 0) || (height <= 0)) {
+		return None;
+	}
+
+	bitmap_sync(bmp);
+	if(bmp->pixmap == None) {
+		return None;
+	}
+
+	for(scaled = bmp->scaled; scaled != NULL; scaled = scaled->next) {
+		if((scaled->width == width) && (scaled->height == height)) {
+			bitmap_scaled_unlink(scaled);
+			bitmap_scaled_push(scaled);
+			*mask = scaled->mask;
+			return scaled->pixmap;
+		}
+	}
+
+	scaled = calloc(1, sizeof(struct bitmap_scaled));
+	if(scaled == NULL) {
+		return None;
+	}
+	scaled->bmp = bmp;
+	scaled->width = width;
+	scaled->height = height;
+	scaled->mask = None;
+
+	if(!bitmap_scale(bmp, scaled)) {
+		free(scaled);
+		return None;
+	}
+
+	// Make room, the newest copy is always kept so it can be drawn
+	kb = nsoption_int(motif_scaled_bitmap_cache_size);
+	budget = (kb > 0) ? ((size_t)kb * 1024) : 0;
+	while((bitmap_scaled_tail != NULL) && ((bitmap_scaled_bytes + scaled->size) > budget)) {
+		bitmap_scaled_free(bitmap_scaled_tail);
+	}
+
+	scaled->next = bmp->scaled;
+	bmp->scaled = scaled;
+	bitmap_scaled_push(scaled);
+	bitmap_scaled_bytes += scaled->size;
+
+	*mask = scaled->mask;
+	return scaled->pixmap;
+}
+
+/**
+ * Free the fill tile of a bitmap.
+ */
+static void bitmap_tile_flush(MotifBitmap *bmp)
+{
+	if((bmp->tile != None) && (bmp->tile != bmp->pixmap)) {
+		XFreePixmap(motifDisplay, bmp->tile);
+	}
+	bmp->tile = None;
+	bitmap_account(bmp);
+}
+
+/* exported function documented in motif/bitmap.h */
+Pixmap bitmap_get_tile(MotifBitmap *bmp, unsigned long bg, int *width, int *height)
+{
+	int tileW;
+	int tileH;
+	GC gc;
+
+	bitmap_sync(bmp);
+
+	if(bmp->pixmap == None) {
+		return None;
+	}
+
+	// the top byte is only set for NS_TRANSPARENT
+	if(bmp->hasMask && (bg & 0xff000000)) {
+		return None;
+	}
+
+	if((bmp->tile != None) && (!bmp->hasMask || (bmp->tileBg == bg))) {
+		*width = bmp->tileWidth;
+		*height = bmp->tileHeight;
+		return bmp->tile;
+	}
+	bitmap_tile_flush(bmp);
+
+	tileW = bmp->width * ((BITMAP_TILE_MIN + bmp->width - 1) / bmp->width);
+	tileH = bmp->height * ((BITMAP_TILE_MIN + bmp->height - 1) / bmp->height);
+
+	if(!bmp->hasMask && (tileW == bmp->width) && (tileH == bmp->height)) {
+		// Large enough and opaque, the bitmap is its own tile
+		bmp->tile = bmp->pixmap;
+	} else {
+		bmp->tile = XCreatePixmap(motifDisplay, XtWindow(motifWindow), tileW, tileH, motifDepth < 24 ? motifDepth : 24);
+		gc = XCreateGC(motifDisplay, bmp->tile, 0, 0);
+
+		if(bmp->hasMask) {
+			XSetForeground(motifDisplay, gc, bg);
+			XFillRectangle(motifDisplay, bmp->tile, gc, 0, 0, tileW, tileH);
+			XSetClipMask(motifDisplay, gc, bmp->mask);
+		}
+
+		for(int y = 0; y < tileH; y += bmp->height) {
+			for(int x = 0; x < tileW; x += bmp->width) {
+				if(bmp->hasMask) {
+					XSetClipOrigin(motifDisplay, gc, x, y);
+				}
+				XCopyArea(motifDisplay, bmp->pixmap, bmp->tile, gc, 0, 0, bmp->width, bmp->height, x, y);
+			}
+		}
+		XFreeGC(motifDisplay, gc);
+	}
+
+	bmp->tileWidth = tileW;
+	bmp->tileHeight = tileH;
+	bmp->tileBg = bg;
+	bitmap_account(bmp);
+
+	*width = tileW;
+	*height = tileH;
+	return bmp->tile;
+}
+
+#ifndef NSMOTIF_USE_GL
+/* whether XRender is used, -1 until first checked */
+static int bitmap_render_state = -1;
+
+/* shifts of the colour channels in server order pixels */
+static int bitmap_red_shift, bitmap_green_shift, bitmap_blue_shift;
+
+static int bitmap_mask_shift(unsigned long mask)
+{
+	int shift = 0;
+
+	while((mask != 0) && !(mask & 1)) {
+		mask >>= 1;
+		shift++;
+	}
+	return shift;
+}
+
+/* exported function documented in motif/bitmap.h */
+bool bitmap_use_render(void)
+{
+	int event_base;
+	int error_base;
+
+	if(bitmap_render_state < 0) {
+		bitmap_render_state = 0;
+		if(nsoption_bool(motif_xrender) &&
+		   XRenderQueryExtension(motifDisplay, &event_base, &error_base) &&
+		   (XRenderFindStandardFormat(motifDisplay, PictStandardARGB32) != NULL) &&
+		   (XRenderFindVisualFormat(motifDisplay, motifVisual) != NULL)) {
+			bitmap_red_shift = bitmap_mask_shift(motifVisual->red_mask);
+			bitmap_green_shift = bitmap_mask_shift(motifVisual->green_mask);
+			bitmap_blue_shift = bitmap_mask_shift(motifVisual->blue_mask);
+			bitmap_render_state = 1;
+		}
+		NSLOG(netsurf, INFO, "XRender compositing %s", bitmap_render_state ? "enabled" : "disabled");
+	}
+
+	return bitmap_render_state == 1;
+}
 
 /**
- * Create a bitmap.
- *
- * \param  width   width of image in pixels
- * \param  height  width of image in pixels
- * \param  state   a flag word indicating the initial state
- * \return an opaque struct bitmap, or NULL on memory exhaustion
+ * Upload a bitmap with alpha as a premultiplied ARGB picture.
  */
-static void *bitmap_create(int width, int height, unsigned int state)
+static Picture bitmap_picture_argb(MotifBitmap *bmp)
 {
-//printf("bitmap_create %dx%d %d\n", width, height, state);
-	MotifBitmap * bmp = (MotifBitmap *)malloc(sizeof(MotifBitmap));
-	if(!bmp) return NULL;
+	unsigned int *src;
+	unsigned int *argb;
+	XImage *ximage;
+	GC gc;
+	int count = bmp->width * bmp->height;
 
-	bmp->buffer = (char *)malloc(width*height*4);
-	bmp->width = width;
-	bmp->height = height;
-	bmp->bpp = 4;
-	bmp->stride = width*4;
-	bmp->opaque = state & BITMAP_OPAQUE ? 1 : 0;
-	memset(bmp->buffer, 0, width*height*4);
-#ifndef NSMOTIF_USE_GL
-	bmp->ximage = XCreateImage(motifDisplay, motifVisual, 24, ZPixmap, 0, bmp->buffer, width, height, 32, width*4);
+	if(!bitmap_client_promote(bmp)) {
+		return None;
+	}
+	src = (unsigned int *)bmp->buffer;
 
-	bmp->pixmap = XCreatePixmap(motifDisplay, XtWindow(motifWindow), width, height, 24);
-	bmp->gc = XCreateGC(motifDisplay, bmp->pixmap, 0, 0);
-#else
-	bmp->ximage = NULL;
-	bmp->pixmap = None;
-	bmp->gc = NULL;
+	argb = (unsigned int *)malloc(count * 4);
+	if(argb == NULL) {
+		return None;
+	}
+
+	for(int i = 0; i < count; i++) {
+		unsigned int p = src[i];
+		unsigned int a = p >> 24;
+		unsigned int r = (((p >> bitmap_red_shift) & 0xff) * a + 127) / 255;
+		unsigned int g = (((p >> bitmap_green_shift) & 0xff) * a + 127) / 255;
+		unsigned int b = (((p >> bitmap_blue_shift) & 0xff) * a + 127) / 255;
+		argb[i] = (a << 24) | (r << 16) | (g << 8) | b;
+	}
+
+	ximage = XCreateImage(motifDisplay, motifVisual, 32, ZPixmap, 0, (char *)argb, bmp->width, bmp->height, 32, bmp->width*4);
+	if(ximage == NULL) {
+		free(argb);
+		return None;
+	}
+
+	bmp->argb = XCreatePixmap(motifDisplay, XtWindow(motifWindow), bmp->width, bmp->height, 32);
+	gc = XCreateGC(motifDisplay, bmp->argb, 0, 0);
+	XPutImage(motifDisplay, bmp->argb, gc, ximage, 0, 0, 0, 0, bmp->width, bmp->height);
+	XFreeGC(motifDisplay, gc);
+	XDestroyImage(ximage);
+
+	return XRenderCreatePicture(motifDisplay, bmp->argb, XRenderFindStandardFormat(motifDisplay, PictStandardARGB32), 0, NULL);
+}
+
+/* exported function documented in motif/bitmap.h */
+Picture bitmap_get_picture(MotifBitmap *bmp, int width, int height, bool repeat)
+{
+	bitmap_sync(bmp);
+	if(bmp->pixmap == None) {
+		return None;
+	}
+
+	if(bmp->picture == None) {
+		if(bmp->hasAlpha) {
+			bmp->picture = bitmap_picture_argb(bmp);
+		} else {
+			bmp->picture = XRenderCreatePicture(motifDisplay, bmp->pixmap, XRenderFindVisualFormat(motifDisplay, motifVisual), 0, NULL);
+		}
+		if(bmp->picture == None) {
+			return None;
+		}
+		bmp->pictureWidth = bmp->width;
+		bmp->pictureHeight = bmp->height;
+		bmp->pictureRepeat = false;
+		bitmap_account(bmp);
+	}
+
+	if((bmp->pictureWidth != width) || (bmp->pictureHeight != height)) {
+		XTransform transform = {{
+			{ XDoubleToFixed((double)bmp->width / width), 0, 0 },
+			{ 0, XDoubleToFixed((double)bmp->height / height), 0 },
+			{ 0, 0, XDoubleToFixed(1) }
+		}};
+
+		XRenderSetPictureTransform(motifDisplay, bmp->picture, &transform);
+		bmp->pictureWidth = width;
+		bmp->pictureHeight = height;
+	}
+
+	if(bmp->pictureRepeat != repeat) {
+		XRenderPictureAttributes attributes;
+
+		attributes.repeat = repeat ? True : False;
+		XRenderChangePicture(motifDisplay, bmp->picture, CPRepeat, &attributes);
+		bmp->pictureRepeat = repeat;
+	}
+
+	return bmp->picture;
+}
+#endif
+
+/**
+ * Free the XRender copy of a bitmap.
+ */
+static void bitmap_picture_flush(MotifBitmap *bmp)
+{
+#ifndef NSMOTIF_USE_GL
+	if(bmp->picture != None) {
+		XRenderFreePicture(motifDisplay, bmp->picture);
+		bmp->picture = None;
+	}
+	if(bmp->argb != None) {
+		XFreePixmap(motifDisplay, bmp->argb);
+		bmp->argb = None;
+	}
+	bitmap_account(bmp);
 #endif
-	bmp->mask = None;
-	bmp->hasMask = 0;
-	return bmp;
 }
 
+/**
+ * Free the server side copies of a bitmap, they are made again when
+ * it is next plotted.
+ */
+static void bitmap_server_free(MotifBitmap *bmp)
+{
+	bitmap_scaled_flush(bmp);
+	bitmap_tile_flush(bmp);
+	bitmap_picture_flush(bmp);
+
+	if(bmp->pixmap != None) {
+		XFreePixmap(motifDisplay, bmp->pixmap);
+		bmp->pixmap = None;
+	}
+	if(bmp->mask != None) {
+		XFreePixmap(motifDisplay, bmp->mask);
+		bmp->mask = None;
+	}
+	bitmap_account(bmp);
+}
 
 /**
- * Return a pointer to the pixel data in a bitmap.
+ * Demote a bitmap the residency manager found cold.
  *
- * \param  bitmap  a bitmap, as returned by bitmap_create()
- * \return pointer to the pixel buffer
+ * Server copies are simply freed. The client buffer is only packed
+ * once it has been converted and uploaded, it is needed again to
+ * upload or scale the bitmap. The GL plotters draw from the buffer so
+ * it is never packed there.
  *
- * The pixel data is packed as BITMAP_FORMAT, possibly with padding at the end
- * of rows. The width of a row in bytes is given by bitmap_get_rowstride().
+ * \param pw The bitmap.
+ * \param tier The tier to demote it from.
+ * \return true if the bitmap was demoted.
  */
-static unsigned char *bitmap_get_buffer(void *bitmap)
+static bool bitmap_demote(void *pw, enum motif_tier tier)
 {
-	MotifBitmap * bmp = (MotifBitmap *)bitmap;
-	return (unsigned char *)bmp->buffer;
+	MotifBitmap *bmp = (MotifBitmap *)pw;
+
+	if(tier == MOTIF_TIER_SERVER) {
+		if(bmp->pixmap == None) {
+			return false;
+		}
+		bitmap_server_free(bmp);
+		return true;
+	}
+
+#ifndef NSMOTIF_USE_GL
+	unsigned int *packed;
+	size_t size;
+
+	if(bmp->dirty || (bmp->pixmap == None) || (bmp->buffer == NULL) || bmp->packFailed) {
+		return false;
+	}
+
+	packed = bitmap_pack((unsigned int *)bmp->buffer, bmp->width * bmp->height, &size);
+	if(packed == NULL) {
+		// Photographs rarely have runs, do not try again until modified
+		bmp->packFailed = true;
+		return false;
+	}
+
+	bitmap_client_free(bmp);
+	bmp->packed = packed;
+	bmp->packedSize = size;
+	bitmap_account(bmp);
+	return true;
+#else
+	return false;
+#endif
 }
 
+/**
+ * Release a bitmap and its server side resources.
+ */
+static void bitmap_release(MotifBitmap *bmp)
+{
+	bitmap_client_free(bmp);
+	free(bmp->packed);
+	if(bmp->pixmap != None) {
+		XFreePixmap(motifDisplay, bmp->pixmap);
+	}
+	if(bmp->mask != None) {
+		XFreePixmap(motifDisplay, bmp->mask);
+	}
+#ifndef NSMOTIF_USE_GL
+	if(bmp->gc != NULL) {
+		XFreeGC(motifDisplay, bmp->gc);
+	}
+#endif
+	free(bmp);
+}
 
 /**
- * Find the width of a pixel row in bytes.
+ * Idle task releasing a few destroyed bitmaps at a time.
  *
- * \param  bitmap  a bitmap, as returned by bitmap_create()
- * \return width of a pixel row in the bitmap
+ * \param p unused
+ * \return true once no destroyed bitmaps remain
  */
-static size_t bitmap_get_rowstride(void *bitmap)
+static bool bitmap_release_dead(void *p)
 {
-	MotifBitmap * bmp = (MotifBitmap *)bitmap;
-	return bmp->stride;	
-}
+	int count;
+
+	for(count = 0; (count < BITMAP_RELEASE_CHUNK) && (bitmap_dead_list != NULL); count++) {
+		struct bitmap_dead *dead = bitmap_dead_list;
+		bitmap_dead_list = dead->next;
+		bitmap_release(dead->bmp);
+		free(dead);
+	}
 
+	return bitmap_dead_list == NULL;
+}
 
 /**
  * Free a bitmap.
@@ -121,21 +1216,25 @@ static void bitmap_destroy(void *bitmap)
 {
 //printf("bitmap_destroy\n");
 	MotifBitmap * bmp = (MotifBitmap *)bitmap;
+	struct bitmap_dead *dead;
 	if(bmp == NULL) return;
 
-#ifndef NSMOTIF_USE_GL
-	XDestroyImage(bmp->ximage);
-	XFreePixmap(motifDisplay, bmp->pixmap);
-	if(bmp->mask != None) {
-		XFreePixmap(motifDisplay, bmp->mask);
-		bmp->mask = None;
+	bitmap_scaled_flush(bmp);
+	bitmap_tile_flush(bmp);
+	bitmap_picture_flush(bmp);
+	motif_resident_remove(&bmp->resident);
+
+	// Releasing the server side copies is left for when we are idle
+	dead = (struct bitmap_dead *)malloc(sizeof(struct bitmap_dead));
+	if((dead == NULL) ||
+	   (motif_schedule_idle(bitmap_release_dead, NULL) != NSERROR_OK)) {
+		free(dead);
+		bitmap_release(bmp);
+		return;
 	}
-	XFreeGC(motifDisplay, bmp->gc);
-#else
-	//XDestroyImage above frees this when not using GL
-	free(bmp->buffer);
-#endif
-	free(bmp);
+	dead->bmp = bmp;
+	dead->next = bitmap_dead_list;
+	bitmap_dead_list = dead;
 }
 
 
@@ -153,89 +1252,294 @@ static bool bitmap_save(void *bitmap, const char *path, unsigned flags)
 }
 
 
+#ifndef NSMOTIF_USE_GL
 /**
- * The bitmap image has changed, so flush any persistant cache.
+ * Convert a band of rows, called on a worker thread so must not use X.
  *
- * \param  bitmap  a bitmap, as returned by bitmap_create()
+ * \param pw The band to convert.
  */
-static void bitmap_modified(void *bitmap) {
-	MotifBitmap * bmp = (MotifBitmap *)bitmap;
-	int *pixels = (int *)bmp->buffer;
-	Display *display = motifDisplay;
-//printf("bitmap_modified %x %d\n", bitmap, bmp->opaque);
+static void bitmap_convert_band(void *pw)
+{
+	struct bitmap_band *band = pw;
+	struct bitmap_conversion *conv = band->conv;
+	MotifBitmap *bmp = conv->bmp;
+	uint32_t *pixels = (uint32_t *)bmp->buffer + (band->y * bmp->width);
+	uint8_t *mask = NULL;
+	unsigned int flags;
 
-#ifndef NSMOTIF_USE_GL
-	int i = 0;
-	if(bmp->opaque) {
-		// We're opaque (jpeg, for instance) so just convert the color data
-		bmp->hasMask = 0;
-		for(int y = 0; y < bmp->height; y++) {
-			for(int x = 0; x < bmp->width; x++) {
-				pixels[i] = ((pixels[i]>>24)&0x000000ff)|((pixels[i]>>8)&0x0000ff00)|((pixels[i]&0x0000ff00)<<8);
-				i++;
-			}
+	// Opaque bitmaps (jpeg, for instance) just convert the color data,
+	// otherwise the mask is built in the same pass since we could have
+	// alpha. Mask rows are whole bytes so bands never share one.
+	if(!conv->opaque) {
+		mask = (uint8_t *)conv->maskBuffer + (band->y * ((bmp->width + 7) >> 3));
+	}
+
+	flags = motif_swizzle(pixels, pixels, bmp->width, band->rows, MOTIF_SWIZZLE_REVERSE, mask);
+	__atomic_or_fetch(&conv->flags, flags, __ATOMIC_RELAXED);
+}
+
+static void bitmap_band_done(void *pw, bool cancelled)
+{
+	free(pw);
+}
+
+/**
+ * Convert the pixel data of a bitmap into server order and build its mask.
+ *
+ * The alpha is kept in the top byte for XRender. Large bitmaps are split
+ * into bands converted by the worker threads, the Xt thread takes bands
+ * too while it waits for the last one.
+ *
+ * \param conv The bitmap conversion.
+ */
+static void bitmap_convert(struct bitmap_conversion *conv)
+{
+	MotifBitmap *bmp = conv->bmp;
+	struct motif_token *token = NULL;
+	int rows = bmp->height;
+
+	conv->flags = 0;
+
+	if((bmp->width * bmp->height) >= BITMAP_PARALLEL_PIXELS) {
+		token = motif_token_create();
+		rows = BITMAP_BAND_PIXELS / bmp->width;
+		if(rows < 1) {
+			rows = 1;
 		}
-	} else {
-#define PUSH_MASK_VALUE(v)						\
-		maskValue = (maskValue>>1)|(v);			\
-		maskBit++;								\
-		if(maskBit == 8) {						\
-			maskBuffer[maskOffset] = maskValue;	\
-			maskValue = 0;						\
-			maskBit = 0;						\
-			maskOffset++;						\
+	}
+
+	for(int y = 0; y < bmp->height; y += rows) {
+		struct bitmap_band local;
+		struct bitmap_band *band = NULL;
+
+		if(token != NULL) {
+			band = malloc(sizeof(struct bitmap_band));
 		}
-#define MASK_NEXT_LINE							\
-		if(maskBit > 0) {						\
-			maskValue >>= (8-maskBit);			\
-			maskBuffer[maskOffset] = maskValue;	\
-			maskValue = 0;						\
-			maskBit = 0;						\
-			maskOffset++;						\
+		if(band == NULL) {
+			band = &local;
 		}
+		band->conv = conv;
+		band->y = y;
+		band->rows = ((bmp->height - y) < rows) ? (bmp->height - y) : rows;
 
-		char *maskBuffer = (char *)malloc(bmp->width*bmp->height);
-		int maskBit = 0;
-		int maskValue = 0;
-		int maskOffset = 0;
-		int hasMask = 0;
-
-		// We do the extra work to generate a mask here since we could have alpha
-		for(int y = 0; y < bmp->height; y++) {
-			for(int x = 0; x < bmp->width; x++) {
-				unsigned int p;
-				if(pixels[i] & 0x00000080)
-				{
-					p = ((pixels[i]>>24)&0x000000ff)|((pixels[i]>>8)&0x0000ff00)|((pixels[i]&0x0000ff00)<<8)|((pixels[i]&0x000000ff)<<24);
-					PUSH_MASK_VALUE(0x0080);
-				} else {
-					p = 0;
-					hasMask = 1;
-					PUSH_MASK_VALUE(0);
-				}
-				pixels[i] = p;
-				i++;
-			}
-			MASK_NEXT_LINE;
+		if(band == &local) {
+			bitmap_convert_band(band);
+		} else if(motif_pool_submit(token, bitmap_convert_band, bitmap_band_done, band) != NSERROR_OK) {
+			bitmap_convert_band(band);
+			free(band);
 		}
+	}
 
-		if(hasMask) {
+	if(token != NULL) {
+		motif_pool_wait(token);
+		motif_token_unref(token);
+	}
+
+	conv->hasMask = (conv->flags & MOTIF_SWIZZLE_MASKED) ? 1 : 0;
+	conv->hasAlpha = (conv->flags & MOTIF_SWIZZLE_ALPHA) ? 1 : 0;
+	bmp->alphaFlags = conv->flags;
+}
+
+/**
+ * Send the converted pixel data of a bitmap to its pixmap.
+ */
+static void bitmap_put(MotifBitmap *bmp)
+{
+	if(bmp->shm != NULL) {
+		bitmap_shm_put(bmp->shm, bmp->pixmap, bmp->gc, bmp->ximage, bmp->width, bmp->height);
+	} else {
+		XPutImage(motifDisplay, bmp->pixmap, bmp->gc, bmp->ximage, 0, 0, 0, 0, bmp->width, bmp->height);
+	}
+}
+
+/**
+ * Send converted pixel data and mask of a bitmap to the server.
+ *
+ * \param bmp The bitmap.
+ * \param conv The completed conversion of the bitmap.
+ */
+static void bitmap_upload(MotifBitmap *bmp, struct bitmap_conversion *conv)
+{
+	if(conv->opaque) {
+		bmp->hasMask = 0;
+		bmp->hasAlpha = 0;
+	} else {
+		bmp->hasAlpha = conv->hasAlpha;
+		if(conv->hasMask) {
 			if(bmp->mask != None) {
 				XFreePixmap(motifDisplay, bmp->mask);
 			}
-			bmp->mask = XCreatePixmapFromBitmapData(motifDisplay, XtWindow(motifWindow), maskBuffer, bmp->width, bmp->height, 1, 0, 1);
+			bmp->mask = XCreatePixmapFromBitmapData(motifDisplay, XtWindow(motifWindow), conv->maskBuffer, bmp->width, bmp->height, 1, 0, 1);
 		} else {
 			if(bmp->mask != None) {
 				XFreePixmap(motifDisplay, bmp->mask);
 				bmp->mask = None;
 			}
 		}
-		bmp->hasMask = hasMask;
-		free(maskBuffer);
+		bmp->hasMask = conv->hasMask;
+		free(conv->maskBuffer);
+		conv->maskBuffer = NULL;
+	}
+
+	bitmap_put(bmp);
+}
+
+/**
+ * Upload a bitmap demoted from the server again.
+ *
+ * The client buffer already holds converted pixels, so only the mask
+ * needs to be built from their alpha.
+ *
+ * \param bmp The bitmap.
+ */
+static void bitmap_reupload(MotifBitmap *bmp)
+{
+	char *maskBuffer;
+
+	if(bmp->hasMask) {
+		maskBuffer = (char *)malloc(((bmp->width+7)>>3)*bmp->height);
+		if(maskBuffer != NULL) {
+			motif_swizzle_mask((uint32_t *)bmp->buffer, bmp->width, bmp->height, (uint8_t *)maskBuffer);
+			bmp->mask = XCreatePixmapFromBitmapData(motifDisplay, XtWindow(motifWindow), maskBuffer, bmp->width, bmp->height, 1, 0, 1);
+			free(maskBuffer);
+		} else {
+			bmp->hasMask = 0;
+		}
+	}
+
+	bitmap_put(bmp);
+}
+#else
+/**
+ * Create the pixmap the X11 plotters draw a bitmap from.
+ *
+ * The buffer is kept as RGBA for the GL plotters, so the pixels are
+ * converted into a copy.
+ *
+ * \param bmp The bitmap.
+ */
+static void bitmap_create_pixmap(MotifBitmap *bmp)
+{
+	int *dest;
+	char *maskBuffer;
+	int hasMask;
+	XImage *ximage;
+	GC gc;
+
+	if(motifDepth < 24) {
+		return;
+	}
+
+	dest = (int *)malloc(bmp->width*bmp->height*4);
+	if(dest == NULL) {
+		return;
+	}
+
+	// We do the extra work to generate a mask here since we could have alpha
+	maskBuffer = (char *)malloc(((bmp->width+7)>>3)*bmp->height);
+	if(maskBuffer == NULL) {
+		free(dest);
+		return;
+	}
+	hasMask = (motif_swizzle((uint32_t *)bmp->buffer, (uint32_t *)dest, bmp->width, bmp->height,
+				 MOTIF_SWIZZLE_ROTATE, (uint8_t *)maskBuffer) & MOTIF_SWIZZLE_MASKED) ? 1 : 0;
+
+	if(hasMask) {
+		bmp->mask = XCreatePixmapFromBitmapData(motifDisplay, XtWindow(motifWindow), maskBuffer, bmp->width, bmp->height, 1, 0, 1);
+	}
+	bmp->hasMask = hasMask;
+	free(maskBuffer);
+
+	ximage = XCreateImage(motifDisplay, motifVisual, 24, ZPixmap, 0, (char *)dest, bmp->width, bmp->height, 32, bmp->width*4);
+	bmp->pixmap = XCreatePixmap(motifDisplay, XtWindow(motifWindow), bmp->width, bmp->height, 24);
+	gc = XCreateGC(motifDisplay, bmp->pixmap, 0, 0);
+
+	XPutImage(motifDisplay, bmp->pixmap, gc, ximage, 0, 0, 0, 0, bmp->width, bmp->height);
+
+	XDestroyImage(ximage);
+	XFreeGC(motifDisplay, gc);
+}
+#endif
+
+/* exported function documented in motif/bitmap.h */
+void bitmap_sync(MotifBitmap *bmp)
+{
+	motif_resident_touch(&bmp->resident);
+
+#ifndef NSMOTIF_USE_GL
+	struct bitmap_conversion conv;
+
+	if(!bmp->dirty && (bmp->pixmap != None)) {
+		return;
+	}
+
+	// A demoted bitmap is expanded and uploaded again
+	if(!bitmap_client_promote(bmp)) {
+		return;
+	}
+	if(bmp->pixmap == None) {
+		bmp->pixmap = XCreatePixmap(motifDisplay, XtWindow(motifWindow), bmp->width, bmp->height, 24);
+		if(bmp->gc == NULL) {
+			bmp->gc = XCreateGC(motifDisplay, bmp->pixmap, 0, 0);
+		}
+		if(!bmp->dirty) {
+			bitmap_reupload(bmp);
+			bitmap_account(bmp);
+			return;
+		}
+	}
+	bmp->dirty = false;
+
+	// the server may still be reading the previous upload
+	if(bmp->shm != NULL) {
+		bitmap_shm_wait(bmp->shm);
+	}
 
+	memset(&conv, 0, sizeof(conv));
+	conv.bmp = bmp;
+	// a bitmap already found to be opaque needs no mask
+	conv.opaque = bmp->opaque || (bmp->alphaFlags == 0);
+	if(!conv.opaque) {
+		conv.maskBuffer = (char *)malloc(bmp->width*bmp->height);
+		if(conv.maskBuffer == NULL) {
+			return;
+		}
+	}
+
+	bitmap_convert(&conv);
+	bitmap_upload(bmp, &conv);
+	free(conv.maskBuffer);
+	bitmap_account(bmp);
+#else
+	if(bmp->pixmap == None) {
+		bitmap_create_pixmap(bmp);
+		bitmap_account(bmp);
 	}
+#endif
+}
+
+/**
+ * The bitmap image has changed, so flush any persistant cache.
+ *
+ * \param  bitmap  a bitmap, as returned by bitmap_create()
+ */
+static void bitmap_modified(void *bitmap) {
+	MotifBitmap * bmp = (MotifBitmap *)bitmap;
+//printf("bitmap_modified %x %d\n", bitmap, bmp->opaque);
+
+	bitmap_scaled_flush(bmp);
+	bitmap_tile_flush(bmp);
+	bitmap_picture_flush(bmp);
+	bitmap_client_promote(bmp);
+	bmp->packFailed = false;
 
-	XPutImage(display, bmp->pixmap, bmp->gc, bmp->ximage, 0, 0, 0, 0, bmp->width, bmp->height);
+#ifndef NSMOTIF_USE_GL
+	// Converting and uploading waits until the bitmap is plotted, so
+	// images never shown cost nothing and repeated changes convert once
+	bmp->dirty = true;
+#else
+	// The pixmap for the X11 plotters is made again when next plotted
+	bitmap_server_free(bmp);
 #endif
 
 }
@@ -263,27 +1567,19 @@ static void bitmap_set_opaque(void *bitmap, bool opaque)
 static bool bitmap_test_opaque(void *bitmap)
 {
 	MotifBitmap * bmp = (MotifBitmap *)bitmap;
-	int *pixels = (int *)bmp->buffer;
 //printf("bitmap_test_opaque %x\n", bitmap);
 
-	if(bmp->hasMask) {
-		return false;
-	}
-
-	int i = 0;
-	for(int y = 0; y < bmp->height; y++) {
-		for(int x = 0; x < bmp->width; x++) {
-			unsigned int p;
-			if((pixels[i] & 0x00000080)) {
-				// Value > 50% alpha
-			} else {
-				return false;
-			}
-			i++;
+	if(bmp->alphaFlags < 0) {
+#ifndef NSMOTIF_USE_GL
+		if(!bmp->dirty) {
+			// converted pixels are no longer RGBA
+			return !bmp->hasMask;
 		}
+#endif
+		bmp->alphaFlags = motif_swizzle_opacity((uint32_t *)bmp->buffer, bmp->width * bmp->height);
 	}
 
-	return true;
+	return !(bmp->alphaFlags & MOTIF_SWIZZLE_MASKED);
 }
 
 
@@ -19,6 +19,15 @@
 #ifndef NS_MOTIF_BITMAP_H
 #define NS_MOTIF_BITMAP_H
 
+#ifndef NSMOTIF_USE_GL
+#include <X11/extensions/Xrender.h>
+#endif
+
+#include "motif/residency.h"
+
+struct bitmap_scaled;
+struct bitmap_shm;
+
 typedef struct {
 	XImage *ximage;
 	Pixmap pixmap;
@@ -29,10 +38,97 @@ typedef struct {
 	int stride;
 	int opaque;
 	int hasMask;
+	bool dirty; /**< pixel data changed since it was last converted */
+	int alphaFlags; /**< MOTIF_SWIZZLE_ flags of the pixels, -1 if not known */
+	struct bitmap_scaled *scaled; /**< cached scaled copies */
+	struct bitmap_shm *shm; /**< segment holding buffer, NULL if malloced */
+	Pixmap tile; /**< repeating fill tile, may be the pixmap itself */
+	int tileWidth, tileHeight;
+	unsigned long tileBg; /**< background a masked tile is composited on */
+	struct motif_resident resident; /**< tiers the pixels are held in */
+	unsigned int *packed; /**< compressed pixels while buffer is demoted */
+	size_t packedSize;
+	bool packFailed; /**< pixels did not compress, not tried until modified */
+	bool pixmapFailed; /**< plotting without a pixmap has been logged */
+#ifndef NSMOTIF_USE_GL
+	int hasAlpha; /**< some pixels are not fully opaque */
+	Pixmap argb; /**< premultiplied copy for XRender, None if opaque */
+	Picture picture; /**< XRender source, None until first composited */
+	int pictureWidth, pictureHeight; /**< size the transform scales to */
+	bool pictureRepeat;
+#endif
 } MotifBitmap;
 
 extern struct gui_bitmap_table *motif_bitmap_table;
 
 bool bitmap_get_opaque(void *bitmap);
 
+/**
+ * Convert and upload a bitmap modified since it was last used.
+ *
+ * Conversion is deferred from bitmap_modified() until the bitmap is
+ * first plotted, so this must be called before the server side copies
+ * of a bitmap are used. A bitmap demoted by the residency manager is
+ * promoted again and marked as the most recently used.
+ *
+ * \param bmp The bitmap to complete.
+ */
+void bitmap_sync(MotifBitmap *bmp);
+
+/**
+ * Get a copy of a bitmap scaled to the size it is plotted at.
+ *
+ * Scaled copies are kept until the bitmap is modified or destroyed,
+ * the least recently used are released to stay within the
+ * motif_scaled_bitmap_cache_size budget. The copy must be used before
+ * any other bitmap is scaled.
+ *
+ * \param bmp The bitmap to scale.
+ * \param width Width to scale it to.
+ * \param height Height to scale it to.
+ * \param mask Updated with the mask of the copy, None if it has none.
+ * \return The scaled copy or None on failure.
+ */
+Pixmap bitmap_get_scaled(MotifBitmap *bmp, int width, int height, Pixmap *mask);
+
+/**
+ * Get an opaque tile for filling an area with repeats of a bitmap.
+ *
+ * Small bitmaps are repeated into a larger tile so filling touches
+ * fewer server tiles. Masked bitmaps are composited onto the
+ * background colour, which makes them opaque.
+ *
+ * \param bmp The bitmap to repeat.
+ * \param bg Background colour, NS_TRANSPARENT if it is not known.
+ * \param width Updated with the tile width.
+ * \param height Updated with the tile height.
+ * \return The tile, or None if the bitmap is masked and the background
+ *         is not known.
+ */
+Pixmap bitmap_get_tile(MotifBitmap *bmp, unsigned long bg, int *width, int *height);
+
+#ifndef NSMOTIF_USE_GL
+/**
+ * Check whether bitmaps are composited with XRender.
+ *
+ * \return true if the server supports XRender and it is enabled.
+ */
+bool bitmap_use_render(void);
+
+/**
+ * Get the XRender picture a bitmap is composited from.
+ *
+ * Bitmaps with alpha are uploaded once as premultiplied ARGB, opaque
+ * bitmaps use their pixmap. The picture transform scales the bitmap
+ * to the given size.
+ *
+ * \param bmp The bitmap.
+ * \param width Width the bitmap is drawn at.
+ * \param height Height the bitmap is drawn at.
+ * \param repeat Whether the picture repeats beyond its edges.
+ * \return The picture or None on failure.
+ */
+Picture bitmap_get_picture(MotifBitmap *bmp, int width, int height, bool repeat);
+#endif
+
 #endif /* NS_FB_BITMAP_H */
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Clip culling shared by the X11 and GL plotters.
+ */
+
+#ifndef NETSURF_MOTIF_CLIP_H
+#define NETSURF_MOTIF_CLIP_H
+
+/**
+ * Check if a box lies wholly outside the clip rectangle.
+ *
+ * Plotters test their bounds first so that primitives outside the
+ * area being redrawn cost a few compares.
+ *
+ * \param clip The clip rectangle of the plotter.
+ */
+static inline bool clip_rejects(const XRectangle *clip, int x0, int y0, int x1, int y1)
+{
+	return (x1 <= clip->x) || (y1 <= clip->y) ||
+	       (x0 >= (clip->x + clip->width)) ||
+	       (y0 >= (clip->y + clip->height));
+}
+
+/**
+ * Check if a line lies wholly outside the clip rectangle.
+ */
+static inline bool clip_rejects_line(const XRectangle *clip, const plot_style_t *style, const struct rect *line)
+{
+	int pad = (plot_style_fixed_to_int(style->stroke_width) / 2) + 1;
+
+	return clip_rejects(clip, ((line->x0 < line->x1) ? line->x0 : line->x1) - pad,
+			    ((line->y0 < line->y1) ? line->y0 : line->y1) - pad,
+			    ((line->x0 > line->x1) ? line->x0 : line->x1) + pad,
+			    ((line->y0 > line->y1) ? line->y0 : line->y1) + pad);
+}
+
+/**
+ * Check if a rectangle and its outline lie wholly outside the clip.
+ */
+static inline bool clip_rejects_rect(const XRectangle *clip, const plot_style_t *style, const struct rect *rect)
+{
+	int pad = 0;
+
+	if (style->stroke_type != PLOT_OP_TYPE_NONE) {
+		pad = (plot_style_fixed_to_int(style->stroke_width) / 2) + 1;
+	}
+
+	return clip_rejects(clip, rect->x0 - pad, rect->y0 - pad, rect->x1 + pad, rect->y1 + pad);
+}
+
+/**
+ * Check if a bitmap plot lies wholly outside the clip.
+ *
+ * Repeating bitmaps fill the clip along the repeated axis.
+ */
+static inline bool clip_rejects_bitmap(const XRectangle *clip, int x, int y, int width, int height, bitmap_flags_t flags)
+{
+	if (!(flags & BITMAPF_REPEAT_X) &&
+	    ((x + width <= clip->x) || (x >= (clip->x + clip->width)))) {
+		return true;
+	}
+	if (!(flags & BITMAPF_REPEAT_Y) &&
+	    ((y + height <= clip->y) || (y >= (clip->y + clip->height)))) {
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Check if a text run lies wholly outside the clip.
+ *
+ * The width is bounded by the widest glyph in the font so the text
+ * need not be converted or measured.
+ */
+static inline bool clip_rejects_text(const XRectangle *clip, XFontStruct *font, int x, int y, size_t length)
+{
+	// Italic and other overhanging glyphs ink beyond their advance
+	int left = (font->max_bounds.lbearing < 0) ? font->max_bounds.lbearing : 0;
+	int right = font->max_bounds.rbearing - font->max_bounds.width;
+
+	return clip_rejects(clip, x + left, y - font->max_bounds.ascent,
+			    x + ((int)length * font->max_bounds.width) + ((right > 0) ? right : 0),
+			    y + font->max_bounds.descent);
+}
+
+#endif
@@ -107,6 +107,7 @@ fb_cw_invalidate(struct core_window *cw, const struct rect *r)
 	clip.x1 = width;
 	clip.y1 = height;
 	hotlist_redraw(0, 0, &clip, &ctx);
+	fb_plot_flush();
 
 	return NSERROR_OK;
 }
@@ -222,6 +223,7 @@ void coreDrawingAreaRedrawCallback(Widget widget, XtPointer client_data, XtPoint
 	}
 
 	hotlist_redraw(0, 0, &clip, &ctx);
+	fb_plot_flush();
 }
 
 void coreDrawingAreaInputCallback(Widget widget, XtPointer client_data, XtPointer call_data)
@@ -480,6 +482,7 @@ void motif_corewindow_init(struct motif_corewindow *cw) {
 	gcv.background = BlackPixelOfScreen(XtScreen(cw->drawingArea));
 	gcv.foreground = WhitePixelOfScreen(XtScreen(cw->drawingArea));
 	cw->gc = XCreateGC(XtDisplay(cw->drawingArea), XtWindow(motifWindow), GCForeground|GCBackground, &gcv);
+	cw->gcState.known = 0;
 
 
 	switch(cw->windowType) {
@@ -36,6 +36,7 @@ struct motif_corewindow {
 	// because I haven't yet abstracted this all out yet
 	Widget drawingArea;
 	GC gc;
+	struct motif_gc_state gcState; /**< values last sent on gc */
 
 	int windowType;
 
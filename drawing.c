@@ -37,15 +37,316 @@
 #include "motif/drawing.h"
 #include "motif/font.h"
 #include "motif/bitmap.h"
+#include "motif/clip.h"
+
+#ifndef NSMOTIF_USE_GL
+#include <X11/extensions/Xrender.h>
+#endif
 
 extern Display *motifDisplay;
 extern Visual *motifVisual;
 extern Widget motifWindow;
 extern int motifDepth;
 
-static XRectangle clipRect;
+/* nothing is culled until the first clip is set */
+static XRectangle clipRect = { -32768, -32768, 65535, 65535 };
+
+/* drawable plotted into instead of the window, None for the window */
+static Drawable plotTarget = None;
+
+#define TARGET ((plotTarget != None) ? plotTarget : XtWindow(gw->drawingArea))
+
+/* primitives sent per batched request */
+#define BATCH_SIZE 256
+
+/* bytes of text held by a batch */
+#define BATCH_TEXT_SIZE 2048
+
+enum batch_kind {
+	BATCH_NONE,
+	BATCH_FILL_RECTANGLES,
+	BATCH_RECTANGLES,
+	BATCH_SEGMENTS,
+	BATCH_TEXT
+};
+
+/**
+ * Primitives of one kind sharing GC state, sent as a single request.
+ *
+ * The batch is flushed before any GC value changes, before anything is
+ * drawn some other way and at the end of each redraw.
+ */
+static struct {
+	enum batch_kind kind;
+	GC gc;
+	Drawable target;
+	int count;
+	union {
+		XRectangle rects[BATCH_SIZE];
+		XSegment segments[BATCH_SIZE];
+		XTextItem items[BATCH_SIZE];
+	} u;
+	int text_x, text_y; /**< start of the text run */
+	int text_pen; /**< x after the last text item */
+	int text_used;
+	char text[BATCH_TEXT_SIZE];
+} batch;
+
+static void batch_flush(void)
+{
+	switch(batch.kind) {
+	case BATCH_FILL_RECTANGLES:
+		XFillRectangles(motifDisplay, batch.target, batch.gc, batch.u.rects, batch.count);
+		break;
+	case BATCH_RECTANGLES:
+		XDrawRectangles(motifDisplay, batch.target, batch.gc, batch.u.rects, batch.count);
+		break;
+	case BATCH_SEGMENTS:
+		XDrawSegments(motifDisplay, batch.target, batch.gc, batch.u.segments, batch.count);
+		break;
+	case BATCH_TEXT:
+		XDrawText(motifDisplay, batch.target, batch.gc, batch.text_x, batch.text_y, batch.u.items, batch.count);
+		break;
+	case BATCH_NONE:
+		break;
+	}
+
+	batch.kind = BATCH_NONE;
+	batch.count = 0;
+	batch.text_used = 0;
+}
+
+/**
+ * Find room for a primitive, flushing whatever cannot share its request.
+ *
+ * \return index of the slot for the primitive.
+ */
+static int batch_add(enum batch_kind kind, GC gc, Drawable target)
+{
+	if((batch.kind != kind) || (batch.gc != gc) ||
+	   (batch.target != target) || (batch.count == BATCH_SIZE)) {
+		batch_flush();
+		batch.kind = kind;
+		batch.gc = gc;
+		batch.target = target;
+	}
+	return batch.count++;
+}
+
+/**
+ * Add a string to the text run, which must share one baseline.
+ */
+static void batch_text(GC gc, Drawable target, XFontStruct *font, int x, int y, const char *text, int length)
+{
+	XTextItem *item;
+
+	if(length > BATCH_TEXT_SIZE) {
+		batch_flush();
+		XDrawString(motifDisplay, target, gc, x, y, text, length);
+		return;
+	}
+
+	if((batch.kind == BATCH_TEXT) &&
+	   ((batch.text_y != y) || ((batch.text_used + length) > BATCH_TEXT_SIZE))) {
+		batch_flush();
+	}
+
+	item = &batch.u.items[batch_add(BATCH_TEXT, gc, target)];
+	if(batch.count == 1) {
+		batch.text_x = x;
+		batch.text_y = y;
+		batch.text_pen = x;
+	}
+
+	memcpy(&batch.text[batch.text_used], text, length);
+	item->chars = &batch.text[batch.text_used];
+	item->nchars = length;
+	item->delta = x - batch.text_pen;
+	item->font = None;
+
+	batch.text_used += length;
+	batch.text_pen = x + XTextWidth(font, text, length);
+}
+
+static inline void gc_foreground(struct gui_window *gw, unsigned long foreground)
+{
+	struct motif_gc_state *state = &gw->gcState;
+
+	if(!(state->known & GCForeground) || (state->foreground != foreground)) {
+		batch_flush();
+		XSetForeground(motifDisplay, gw->gc, foreground);
+		state->foreground = foreground;
+		state->known |= GCForeground;
+	}
+}
+
+static inline void gc_fill_style(struct gui_window *gw, int fill_style)
+{
+	struct motif_gc_state *state = &gw->gcState;
+
+	if(!(state->known & GCFillStyle) || (state->fill_style != fill_style)) {
+		batch_flush();
+		XSetFillStyle(motifDisplay, gw->gc, fill_style);
+		state->fill_style = fill_style;
+		state->known |= GCFillStyle;
+	}
+}
+
+static inline void gc_font(struct gui_window *gw, Font font)
+{
+	struct motif_gc_state *state = &gw->gcState;
+
+	if(!(state->known & GCFont) || (state->font != font)) {
+		batch_flush();
+		XSetFont(motifDisplay, gw->gc, font);
+		state->font = font;
+		state->known |= GCFont;
+	}
+}
+
+static inline void gc_line(struct gui_window *gw, unsigned int line_width, int line_style)
+{
+	struct motif_gc_state *state = &gw->gcState;
+
+	if(!(state->known & GCLineWidth) ||
+	   (state->line_width != line_width) ||
+	   (state->line_style != line_style)) {
+		batch_flush();
+		XSetLineAttributes(motifDisplay, gw->gc, line_width, line_style, CapNotLast, JoinMiter);
+		state->line_width = line_width;
+		state->line_style = line_style;
+		state->known |= GCLineWidth;
+	}
+}
+
+/**
+ * Clip the GC of a window to a single rectangle.
+ */
+static void gc_clip_rect(struct gui_window *gw, const XRectangle *rect)
+{
+	struct motif_gc_state *state = &gw->gcState;
+
+	if((state->known & GCClipMask) && state->clip_rect &&
+	   (state->clip.x == rect->x) && (state->clip.y == rect->y) &&
+	   (state->clip.width == rect->width) && (state->clip.height == rect->height)) {
+		return;
+	}
+
+	batch_flush();
+	XSetClipRectangles(motifDisplay, gw->gc, 0, 0, (XRectangle *)rect, 1, Unsorted);
+	state->clip_rect = true;
+	state->clip = *rect;
+	state->clip_mask = None;
+	state->clip_x = 0;
+	state->clip_y = 0;
+	state->known |= GCClipMask;
+}
+
+/**
+ * Clip the GC of a window to a bitmap mask, or not at all if the mask is None.
+ */
+static void gc_clip_mask(struct gui_window *gw, Pixmap mask, int x, int y)
+{
+	struct motif_gc_state *state = &gw->gcState;
+
+	if(!(state->known & GCClipMask) || (state->clip_x != x) || (state->clip_y != y)) {
+		batch_flush();
+		XSetClipOrigin(motifDisplay, gw->gc, x, y);
+		state->clip_x = x;
+		state->clip_y = y;
+	}
+	if(!(state->known & GCClipMask) || state->clip_rect || (state->clip_mask != mask)) {
+		batch_flush();
+		XSetClipMask(motifDisplay, gw->gc, mask);
+		state->clip_rect = false;
+		state->clip_mask = mask;
+	}
+	state->known |= GCClipMask;
+}
+
+#ifndef NSMOTIF_USE_GL
+/* XRender picture of renderDrawable, None until a bitmap is composited */
+static Picture renderTarget = None;
+static Drawable renderDrawable = None;
+
+/* clip last set on renderTarget */
+static XRectangle renderClip;
+
+/**
+ * Free the destination picture, drawables may go away once a redraw ends.
+ */
+static void render_reset(void)
+{
+	if(renderTarget != None) {
+		XRenderFreePicture(motifDisplay, renderTarget);
+		renderTarget = None;
+	}
+}
+
+/**
+ * Get a destination picture for a drawable clipped to the plot clip.
+ */
+static Picture render_target(Drawable drawable)
+{
+	XRenderPictFormat *format;
+
+	if((renderTarget == None) || (renderDrawable != drawable)) {
+		render_reset();
+		format = XRenderFindVisualFormat(motifDisplay, motifVisual);
+		if(format == NULL) {
+			return None;
+		}
+		renderTarget = XRenderCreatePicture(motifDisplay, drawable, format, 0, NULL);
+		renderDrawable = drawable;
+	} else if((renderClip.x == clipRect.x) && (renderClip.y == clipRect.y) &&
+		  (renderClip.width == clipRect.width) && (renderClip.height == clipRect.height)) {
+		return renderTarget;
+	}
+
+	XRenderSetPictureClipRectangles(motifDisplay, renderTarget, 0, 0, &clipRect, 1);
+	renderClip = clipRect;
+	return renderTarget;
+}
+#endif
+
+/* exported function documented in motif/drawing.h */
+Drawable fb_plot_set_target(Drawable target)
+{
+	Drawable previous = plotTarget;
+
+	batch_flush();
+#ifndef NSMOTIF_USE_GL
+	render_reset();
+#endif
+	plotTarget = target;
+	return previous;
+}
+
+/* exported function documented in motif/drawing.h */
+void fb_plot_flush(void)
+{
+	batch_flush();
+#ifndef NSMOTIF_USE_GL
+	render_reset();
+#endif
+}
+
+/* exported function documented in motif/drawing.h */
+void fb_plot_unclip(struct gui_window *gw)
+{
+	batch_flush();
+	gc_clip_mask(gw, None, 0, 0);
+}
 
-#define TARGET XtWindow(gw->drawingArea)
+/* exported function documented in motif/drawing.h */
+void fb_plot_gc_changed(struct gui_window *gw)
+{
+	batch_flush();
+#ifndef NSMOTIF_USE_GL
+	render_reset();
+#endif
+	gw->gcState.known = 0;
+}
 
 /**
  * \brief Sets a clip rectangle for subsequent plot operations.
@@ -69,7 +370,7 @@ framebuffer_plot_clip(const struct redraw_context *ctx, const struct rect *clip)
 	clipRect.width = clip->x1-clip->x0;
 	clipRect.height = clip->y1-clip->y0;
 
-	XSetClipRectangles(motifDisplay, gw->gc, 0, 0, &clipRect, 1, Unsorted);
+	gc_clip_rect(gw, &clipRect);
 
 	return NSERROR_OK;
 }
@@ -103,10 +404,15 @@ framebuffer_plot_arc(const struct redraw_context *ctx,
 	}
 
 //printf("framebuffer_plot_arc\n");
+	if(clip_rejects(&clipRect, x - 1, y - 1, x + (radius * 2) + 1, y + (radius * 2) + 1)) {
+		return NSERROR_OK;
+	}
+
 	Display *display = motifDisplay;
 	GC gc = gw->gc;
 
-	XSetForeground(display, gc, style->fill_colour);
+	gc_foreground(gw, style->fill_colour);
+	batch_flush();
 	XDrawArc(display, TARGET, gc, x, y, radius*2, radius*2, angle1<<5, angle2<<5);
 	return NSERROR_OK;
 }
@@ -136,16 +442,22 @@ framebuffer_plot_disc(const struct redraw_context *ctx,
 	}
 
 //printf("framebuffer_plot_disc\n");
+	if(clip_rejects(&clipRect, x - 1, y - 1, x + (radius * 2) + 1, y + (radius * 2) + 1)) {
+		return NSERROR_OK;
+	}
+
 	Display *display = motifDisplay;
 	GC gc = gw->gc;
 
 	if (style->fill_type != PLOT_OP_TYPE_NONE) {
-		XSetForeground(display, gc, style->fill_colour);
+		gc_foreground(gw, style->fill_colour);
+		batch_flush();
 		XFillArc(display, TARGET, gc, x, y, radius*2, radius*2, 0<<5, 360<<5);
 	}
 
 	if (style->stroke_type != PLOT_OP_TYPE_NONE) {
-		XSetForeground(display, gc, style->stroke_colour);
+		gc_foreground(gw, style->stroke_colour);
+		batch_flush();
 		XDrawArc(display, TARGET, gc, x, y, radius*2, radius*2, 0<<5, 360<<5);
 	}
 	return NSERROR_OK;
@@ -175,6 +487,9 @@ motif_plot_line(const struct redraw_context *ctx,
 	}
 
 //printf("motif_plot_line\n");
+	if(clip_rejects_line(&clipRect, style, line)) {
+		return NSERROR_OK;
+	}
 
 	/*
 	if (style->stroke_type != PLOT_OP_TYPE_NONE) {
@@ -205,9 +520,14 @@ motif_plot_line(const struct redraw_context *ctx,
 			dashed = true;
 		}
 
-		XSetForeground(display, gc, style->stroke_colour);
-		XSetLineAttributes(display, gc, plot_style_fixed_to_int(style->stroke_width), dashed?LineOnOffDash:LineSolid, CapNotLast, JoinMiter);
-		XDrawLine(display, TARGET, gc, line->x0, line->y0, line->x1, line->y1);
+		gc_foreground(gw, style->stroke_colour);
+		gc_line(gw, plot_style_fixed_to_int(style->stroke_width), dashed?LineOnOffDash:LineSolid);
+		XSegment *segment = &batch.u.segments[batch_add(BATCH_SEGMENTS, gc, TARGET)];
+
+		segment->x1 = line->x0;
+		segment->y1 = line->y0;
+		segment->x2 = line->x1;
+		segment->y2 = line->y1;
 	}
 
 	return NSERROR_OK;
@@ -239,6 +559,10 @@ framebuffer_plot_rectangle(const struct redraw_context *ctx,
 	}
 
 //printf("framebuffer_plot_rectangle (%d, %d)->(%d, %d) @ %x/%x\n", nsrect->x0, nsrect->y0, nsrect->x1, nsrect->y1, style->fill_colour, style->stroke_colour);
+	if(clip_rejects_rect(&clipRect, style, nsrect)) {
+		return NSERROR_OK;
+	}
+
 	Display *display = motifDisplay;
 	GC gc = gw->gc;
 	XRectangle xrect;
@@ -253,9 +577,9 @@ framebuffer_plot_rectangle(const struct redraw_context *ctx,
 
 
 	if (style->fill_type != PLOT_OP_TYPE_NONE) {
-		XSetForeground(display, gc, style->fill_colour);
-		XSetFillStyle(display, gc, FillSolid);
-		XFillRectangle(display, TARGET, gc, xrect.x, xrect.y, xrect.width, xrect.height);
+		gc_foreground(gw, style->fill_colour);
+		gc_fill_style(gw, FillSolid);
+		batch.u.rects[batch_add(BATCH_FILL_RECTANGLES, gc, TARGET)] = xrect;
 	}
 
 	if (style->stroke_type != PLOT_OP_TYPE_NONE) {
@@ -267,9 +591,9 @@ framebuffer_plot_rectangle(const struct redraw_context *ctx,
 			dashed = true;
 		}
 
-		XSetForeground(display, gc, style->stroke_colour);
-		XSetLineAttributes(display, gc, plot_style_fixed_to_int(style->stroke_width), dashed?LineOnOffDash:LineSolid, CapNotLast, JoinMiter);
-		XDrawRectangle(display, TARGET, gc, xrect.x, xrect.y, xrect.width, xrect.height);
+		gc_foreground(gw, style->stroke_colour);
+		gc_line(gw, plot_style_fixed_to_int(style->stroke_width), dashed?LineOnOffDash:LineSolid);
+		batch.u.rects[batch_add(BATCH_RECTANGLES, gc, TARGET)] = xrect;
 	}
 
 	return NSERROR_OK;
@@ -307,7 +631,21 @@ framebuffer_plot_polygon(const struct redraw_context *ctx,
 	GC gc = gw->gc;
 
 //printf("framebuffer_plot_polygon\n");
-	if (style->fill_type != PLOT_OP_TYPE_NONE) {
+	if ((style->fill_type != PLOT_OP_TYPE_NONE) && (n > 0)) {
+		int x0 = p[0], y0 = p[1], x1 = p[0], y1 = p[1];
+
+		for(int i = 1; i < n; i++) {
+			int px = p[(i<<1)+0];
+			int py = p[(i<<1)+1];
+			if(px < x0) x0 = px;
+			if(px > x1) x1 = px;
+			if(py < y0) y0 = py;
+			if(py > y1) y1 = py;
+		}
+		if(clip_rejects(&clipRect, x0, y0, x1 + 1, y1 + 1)) {
+			return NSERROR_OK;
+		}
+
 		XPoint *points = (XPoint *)malloc(n*sizeof(XPoint));
 		for(int i = 0; i < n; i++)
 		{
@@ -315,8 +653,9 @@ framebuffer_plot_polygon(const struct redraw_context *ctx,
 			points[i].y = p[(i<<1)+1];
 		}
 
-		XSetForeground(display, gc, style->fill_colour);
-		XSetFillStyle(display, gc, FillSolid);
+		gc_foreground(gw, style->fill_colour);
+		gc_fill_style(gw, FillSolid);
+		batch_flush();
 		XFillPolygon(display, TARGET, gc, points, n, Complex, CoordModeOrigin);
 		free(points);
 	}
@@ -350,166 +689,6 @@ framebuffer_plot_path(const struct redraw_context *ctx,
 	return NSERROR_OK;
 }
 
-#ifdef NSMOTIF_USE_GL
-static Pixmap createPixmap(MotifBitmap *bmp) {
-	int *dest = (int *)malloc(bmp->width*bmp->height*4);
-	int *pixels = (int *)bmp->buffer;
-	Display *display = motifDisplay;
-//printf("bitmap_modified %x %d\n", bitmap, bmp->opaque);
-
-	if(motifDepth < 24) return None;
-
-	int i = 0;
-
-#define PUSH_MASK_VALUE(v)					\
-	maskValue = (maskValue>>1)|(v);			\
-	maskBit++;								\
-	if(maskBit == 8) {						\
-		maskBuffer[maskOffset] = maskValue;	\
-		maskValue = 0;						\
-		maskBit = 0;						\
-		maskOffset++;						\
-	}
-#define MASK_NEXT_LINE						\
-	if(maskBit > 0) {						\
-		maskValue >>= (8-maskBit);			\
-		maskBuffer[maskOffset] = maskValue;	\
-		maskValue = 0;						\
-		maskBit = 0;						\
-		maskOffset++;						\
-	}
-
-	char *maskBuffer = (char *)malloc(bmp->width*bmp->height);
-	int maskBit = 0;
-	int maskValue = 0;
-	int maskOffset = 0;
-	int hasMask = 0;
-
-	// We do the extra work to generate a mask here since we could have alpha
-	for(int y = 0; y < bmp->height; y++) {
-		for(int x = 0; x < bmp->width; x++) {
-			unsigned int p;
-			if(pixels[i] & 0x00000080)
-			{
-				p = ((pixels[i]>>8) & 0x00ffffff) |
-					((pixels[i]&0x00ff) << 24);
-				PUSH_MASK_VALUE(0x0080);
-			} else {
-				p = 0;
-				hasMask = 1;
-				PUSH_MASK_VALUE(0);
-			}
-			dest[i] = p;
-			i++;
-		}
-		MASK_NEXT_LINE;
-	}
-
-	if(hasMask) {
-		if(bmp->mask != None) {
-			XFreePixmap(motifDisplay, bmp->mask);
-		}
-		bmp->mask = XCreatePixmapFromBitmapData(motifDisplay, XtWindow(motifWindow), maskBuffer, bmp->width, bmp->height, 1, 0, 1);
-	} else {
-		if(bmp->mask != None) {
-			XFreePixmap(motifDisplay, bmp->mask);
-			bmp->mask = None;
-		}
-	}
-	bmp->hasMask = hasMask;
-	free(maskBuffer);
-
-#undef PUSH_MASK_VALUE
-#undef MASK_NEXT_LINE
-
-	XImage *ximage = XCreateImage(display, motifVisual, 24, ZPixmap, 0, (char *)dest, bmp->width, bmp->height, 32, bmp->width*4);
-	Pixmap pixmap = XCreatePixmap(motifDisplay, XtWindow(motifWindow), bmp->width, bmp->height, motifDepth < 24 ? motifDepth : 24);
-	GC gc = XCreateGC(motifDisplay, pixmap, 0, 0);
-
-	XPutImage(display, pixmap, gc, ximage, 0, 0, 0, 0, bmp->width, bmp->height);
-	
-	XDestroyImage(ximage);
-	XFreeGC(motifDisplay, gc);
-
-	bmp->pixmap = pixmap;
-	return pixmap;
-}
-#endif
-
-
-static Pixmap scaleBitmap(MotifBitmap *bmp, int x, int y, int w, int h, int scaledW, int scaledH, float scaleX, float scaleY, int drawX, int drawY, GC drawingGC) {
-	unsigned int * src = (unsigned int *)bmp->buffer;
-	unsigned int * dest = (unsigned int *)malloc(scaledW*scaledH*4);
-
-	Display *display = motifDisplay;
-//printf("scaling bitmap source %d,%d from %dx%d to %dx%d factor %f,%f to %d,%d\n", x, y, w, h, scaledW, scaledH, (1.0f/scaleX), (1.0f/scaleY), drawX, drawY);
-
-	XImage *ximage = XCreateImage(display, motifVisual, 24, ZPixmap, 0, (unsigned char *)dest, scaledW, scaledH, 32, scaledW*4);
-
-#define PUSH_MASK_VALUE(v)						\
-		maskValue = (maskValue>>1)|(v);			\
-		maskBit++;								\
-		if(maskBit == 8) {						\
-			maskBuffer[maskOffset] = maskValue;	\
-			maskValue = 0;						\
-			maskBit = 0;						\
-			maskOffset++;						\
-		}
-#define MASK_NEXT_LINE							\
-		if(maskBit > 0) {						\
-			maskValue >>= (8-maskBit);			\
-			maskBuffer[maskOffset] = maskValue;	\
-			maskValue = 0;						\
-			maskBit = 0;						\
-			maskOffset++;						\
-		}
-
-	char *maskBuffer = (char *)malloc(scaledW*scaledH);
-	int maskBit = 0;
-	int maskValue = 0;
-	int maskOffset = 0;
-	int hasMask = 0;
-
-	float curX = (x*scaleX);
-	float curY = (y*scaleY);
-
-	int i = 0;
-	int curYOff = ((int)curY)*w;
-
-	for(int iy = 0; iy < scaledH; iy++) {
-		curX = (x*scaleX);
-		for(int ix = 0; ix < scaledW; ix++) {
-			unsigned int p = src[curYOff+((int)curX)];
-			dest[i] = p;
-			curX += scaleX;
-			if(p & 0xff000000) {
-				PUSH_MASK_VALUE(0x00000080);
-			} else {
-				PUSH_MASK_VALUE(0);
-			}
-			i++;
-		}
-		MASK_NEXT_LINE;
-
-		curY += scaleY;
-		curYOff = ((int)curY)*w;
-	}
-
-	if(bmp->hasMask) {
-		Pixmap maskPixmap = XCreatePixmapFromBitmapData(display, XtWindow(motifWindow), maskBuffer, scaledW, scaledH, 1, 0, 1);
-		XSetClipOrigin(display, drawingGC, drawX, drawY);
-		XSetClipMask(display, drawingGC, maskPixmap);
-		XFreePixmap(display, maskPixmap);
-	}
-	free(maskBuffer);
-
-	Pixmap scaledPixmap = XCreatePixmap(display, XtWindow(motifWindow), scaledW, scaledH, motifDepth < 24 ? motifDepth : 24);
-	GC gc = XCreateGC(display, scaledPixmap, 0, 0);
-	XPutImage(display, scaledPixmap, gc, ximage, 0, 0, 0, 0, scaledW, scaledH);
-	XDestroyImage(ximage);
-	XFreeGC(display, gc);
-	return scaledPixmap;
-}
 
 /**
  * Plot a bitmap
@@ -555,18 +734,20 @@ framebuffer_plot_bitmap(const struct redraw_context *ctx,
 	MotifBitmap *bmp = (MotifBitmap *)bitmap;
 //printf("framebuffer_plot_bitmap: (%d,%d) %dx%d\n", x, y, width, height);
 
-#ifdef NSMOTIF_USE_GL
-	if(bmp->pixmap == None) {
-		if(!createPixmap(bmp)) {
-			printf("Failed to create pixmap\n");
-			return NSERROR_OK;
-		}
+	if(clip_rejects_bitmap(&clipRect, x, y, width, height, flags)) {
+		return NSERROR_OK;
 	}
-#endif
 
-	if(bmp->hasMask) {
-		XSetClipOrigin(motifDisplay, gw->gc, x, y);
-		XSetClipMask(motifDisplay, gw->gc, bmp->mask);
+	bitmap_sync(bmp);
+
+	batch_flush();
+
+	if(bmp->pixmap == None) {
+		if(!bmp->pixmapFailed) {
+			NSLOG(netsurf, INFO, "Unable to create pixmap for %dx%d bitmap", bmp->width, bmp->height);
+			bmp->pixmapFailed = true;
+		}
+		return NSERROR_OK;
 	}
 
 	int srcX = 0;
@@ -614,26 +795,44 @@ framebuffer_plot_bitmap(const struct redraw_context *ctx,
 		drawH = (clipRect.y+clipRect.height)-drawY;
 	}
 
-	// Fast-track the repeating here if possible?
-	// Need to look into this, it's crashing w/ BadPixmap
-	/* if((repeatX || repeatY) && !bmp->hasMask && width == bmp->width && height == bmp->height) {
-printf("Fast-trackign fill of %dx%d region with %dx%d image\n", clipRect.width, clipRect.height, bmp->width, bmp->height);
-		XRectangle fillRect;
-		fillRect.x = x;
-		fillRect.y = y;
-		fillRect.width = (clipRect.x + clipRect.width)-x;
-		fillRect.height = (clipRect.y + clipRect.height)-y;
-
-		XSetFillStyle(motifDisplay, gw->gc, FillTiled);
-		XSetTile(motifDisplay, gw->gc, bmp->pixmap);
-		
-		XFillRectangle(motifDisplay, TARGET, gw->gc, fillRect.x, fillRect.y, fillRect.width, fillRect.height);
-
-		XSetFillStyle(motifDisplay, gw->gc, FillSolid);
-		XSetTile(motifDisplay, gw->gc, None);
-		
-		return NSERROR_OK;
-	}*/
+#ifndef NSMOTIF_USE_GL
+	// XRender blends the alpha, scales and repeats on the server
+	if((drawW > 0) && (drawH > 0) && bitmap_use_render()) {
+		bool repeat = repeatX || repeatY;
+		bool hasScale = ((bmp->width != width) || (bmp->height != height)) && !repeat;
+		Picture src = bitmap_get_picture(bmp, hasScale ? width : bmp->width, hasScale ? height : bmp->height, repeat);
+		Picture dst = render_target(TARGET);
+
+		if((src != None) && (dst != None)) {
+			XRenderComposite(motifDisplay, bmp->hasAlpha ? PictOpOver : PictOpSrc, src, None, dst,
+					 drawX-x, drawY-y, 0, 0, drawX, drawY, drawW, drawH);
+			return NSERROR_OK;
+		}
+	}
+#endif
+
+	if((repeatX || repeatY) && (drawW > 0) && (drawH > 0) &&
+	   ((drawW > srcW) || (drawH > srcH))) {
+		int tileW;
+		int tileH;
+		Pixmap tile = bitmap_get_tile(bmp, bg, &tileW, &tileH);
+
+		// Let the server repeat the tile, the tile must not be reset
+		// to None afterwards as that is a BadPixmap
+		if(tile != None) {
+			gc_clip_rect(gw, &clipRect);
+			gc_fill_style(gw, FillTiled);
+			XSetTile(motifDisplay, gw->gc, tile);
+			XSetTSOrigin(motifDisplay, gw->gc, x, y);
+			XFillRectangle(motifDisplay, TARGET, gw->gc, drawX, drawY, drawW, drawH);
+			gc_fill_style(gw, FillSolid);
+			return NSERROR_OK;
+		}
+	}
+
+	if(bmp->hasMask) {
+		gc_clip_mask(gw, bmp->mask, x, y);
+	}
 
 	if((repeatX && drawW>(srcW-srcX)) || (repeatY && drawH>(srcH-srcY))) {
 //		printf("drawing repeating %dx%d image into %dx%d area, starting offset %d,%d\n", srcW, srcH, drawW, drawH, srcX, srcY);
@@ -669,20 +868,21 @@ printf("Fast-trackign fill of %dx%d region with %dx%d image\n", clipRect.width,
 			if(!hasScale) {
 				XCopyArea(motifDisplay, bmp->pixmap, TARGET, gw->gc, srcX, srcY, drawW, drawH, drawX, drawY);
 			} else {
-				float scaleX = ((float)bmp->width)/((float)width);
-				float scaleY = ((float)bmp->height)/((float)height);
-
-				Pixmap scaledPixmap = scaleBitmap(bmp, srcX, srcY, srcW, srcH, drawW, drawH, scaleX, scaleY, drawX, drawY, gw->gc);
-				XCopyArea(motifDisplay, scaledPixmap, TARGET, gw->gc, 0, 0, drawW, drawH, drawX, drawY);
-				XFreePixmap(motifDisplay, scaledPixmap);
+				Pixmap scaledMask;
+				Pixmap scaledPixmap = bitmap_get_scaled(bmp, width, height, &scaledMask);
+
+				if(scaledPixmap != None) {
+					if(scaledMask != None) {
+						gc_clip_mask(gw, scaledMask, x, y);
+					}
+					XCopyArea(motifDisplay, scaledPixmap, TARGET, gw->gc, drawX-x, drawY-y, drawW, drawH, drawX, drawY);
+				}
 			}
 		}
 	}
 
 	if(bmp->hasMask) {
-		XSetClipOrigin(motifDisplay, gw->gc, 0, 0);
-		XSetClipMask(motifDisplay, gw->gc, None);
-		XSetClipRectangles(motifDisplay, gw->gc, 0, 0, &clipRect, 1, Unsorted);
+		gc_clip_rect(gw, &clipRect);
 	}
 
 	return NSERROR_OK;
@@ -714,13 +914,17 @@ framebuffer_plot_text(const struct redraw_context *ctx,
 		return NSERROR_OK;
 	}
 
-	const char *utf8Free = stringToUTF8FreeString(text, length);
 	XFontStruct *fontStruct = fontStructForFontStyle(fstyle);
+	if(clip_rejects_text(&clipRect, fontStruct, x, y, length)) {
+		return NSERROR_OK;
+	}
+
+	const char *utf8Free = stringToUTF8FreeString(text, length);
 
 //printf("framebuffer_plot_text (%d, %d): %s\n", x, y, text);
-	XSetForeground(motifDisplay, gw->gc, fstyle->foreground);
-	XSetFont(motifDisplay, gw->gc, fontStruct->fid);
-	XDrawString(motifDisplay, TARGET, gw->gc, x, y, utf8Free, strlen(utf8Free));
+	gc_foreground(gw, fstyle->foreground);
+	gc_font(gw, fontStruct->fid);
+	batch_text(gw->gc, TARGET, fontStruct, x, y, utf8Free, strlen(utf8Free));
 	//XDrawString(motifDisplay, TARGET, gw->gc, x, y, text, length);
 
 	free(utf8Free);
@@ -24,8 +24,48 @@
 #ifndef NETSURF_MOTIF_DRAWING_H
 #define NETSURF_MOTIF_DRAWING_H
 
+struct gui_window;
+
 extern const struct plotter_table fb_plotters;
 
+/**
+ * Redirect the X11 plotters into an off-screen drawable.
+ *
+ * The drawable must match the depth of the window being redrawn and
+ * share its coordinates.
+ *
+ * \param target The drawable to plot into or None for the window.
+ * \return The drawable previously plotted into.
+ */
+Drawable fb_plot_set_target(Drawable target);
+
+/**
+ * Send any primitives the X11 plotters are still batching.
+ *
+ * Must be called at the end of each redraw.
+ */
+void fb_plot_flush(void);
+
+/**
+ * Remove any clipping from the GC of a window.
+ *
+ * The X11 plotters only send GC values which changed, this keeps their
+ * record of the GC accurate.
+ *
+ * \param gw The window whose GC to unclip.
+ */
+void fb_plot_unclip(struct gui_window *gw);
+
+/**
+ * Forget the values the X11 plotters sent on the GC of a window.
+ *
+ * Must be called after changing the GC in any other way and before
+ * freeing it.
+ *
+ * \param gw The window whose GC changed.
+ */
+void fb_plot_gc_changed(struct gui_window *gw);
+
 #ifdef NSMOTIF_USE_GL
 extern const struct plotter_table motifgl_plotters;
 #endif
@@ -37,6 +37,7 @@
 #include "motif/drawing.h"
 #include "motif/font.h"
 #include "motif/bitmap.h"
+#include "motif/clip.h"
 
 #ifdef NSMOTIF_USE_GL
 #include "/usr/include/GL/glxtokens.h"
@@ -46,7 +47,8 @@ extern Display *motifDisplay;
 extern Visual *motifVisual;
 extern Widget motifWindow;
 
-static XRectangle clipRect;
+/* nothing is culled until the first clip is set */
+static XRectangle clipRect = { -32768, -32768, 65535, 65535 };
 
 #define TARGET XtWindow(gw->drawingArea)
 
@@ -216,6 +218,10 @@ motifgl_plot_line(const struct redraw_context *ctx,
 	bool dotted = false;
 	bool dashed = false;
 
+	if(clip_rejects_line(&clipRect, style, line)) {
+		return NSERROR_OK;
+	}
+
 	if (style->stroke_type != PLOT_OP_TYPE_NONE) {
 		if (style->stroke_type == PLOT_OP_TYPE_DOT) {
 			dotted = true;
@@ -272,6 +278,10 @@ motifgl_plot_rectangle(const struct redraw_context *ctx,
 	}
 
 //printf("motifgl_plot_rectangle (%d, %d)->(%d, %d) @ %x/%x\n", nsrect->x0, nsrect->y0, nsrect->x1, nsrect->y1, style->fill_colour, style->stroke_colour);
+	if(clip_rejects_rect(&clipRect, style, nsrect)) {
+		return NSERROR_OK;
+	}
+
 	Display *display = motifDisplay;
 	//GC gc = gw->gc;
 	XRectangle xrect;
@@ -449,6 +459,10 @@ motifgl_plot_bitmap(const struct redraw_context *ctx,
 	MotifBitmap *bmp = (MotifBitmap *)bitmap;
 //printf("motifgl_plot_bitmap: (%d,%d) %dx%d\n", x, y, width, height);
 
+	if(clip_rejects_bitmap(&clipRect, x, y, width, height, flags)) {
+		return NSERROR_OK;
+	}
+
 	int srcX = 0;
 	int srcY = 0;
 	int srcW = bmp->width;
@@ -599,9 +613,13 @@ motifgl_plot_text(const struct redraw_context *ctx,
 		return NSERROR_OK;
 	}
 
+	XFontStruct *fontStruct = fontStructForFontStyle(fstyle);
+	if(clip_rejects_text(&clipRect, fontStruct, x, y, length)) {
+		return NSERROR_OK;
+	}
+
 	const char *utf8Free = stringToUTF8FreeString(text, length);
 	const char *ptr = utf8Free;	// This may be offset if x<0
-	XFontStruct *fontStruct = fontStructForFontStyle(fstyle);
 
 	if(cachedFontSize == 0) {
 		cachedFontStructs = (XFontStruct **)malloc(8 * sizeof(XFontStruct *));
@@ -0,0 +1,222 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Motif main event loop.
+ *
+ * Xt already waits in poll()/select() on the X connection and honours
+ * its own timers, so the core fetcher sockets and a self-pipe are
+ * registered as additional Xt input sources. Each pass through the
+ * loop dispatches exactly one ready source and then refreshes the
+ * fetcher descriptor set.
+ */
+
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "utils/log.h"
+#include "utils/errors.h"
+#include "content/fetch.h"
+
+#include <X11/Intrinsic.h>
+
+#include "motif/schedule.h"
+#include "motif/event.h"
+#include "motif/watchdog.h"
+#include "motif/residency.h"
+
+#define EVENT_FD_READ 0
+#define EVENT_FD_WRITE 1
+#define EVENT_FD_EXCEPT 2
+
+static XtAppContext event_app = NULL;
+
+/* self-pipe used to wake the loop, -1 when not open */
+static int event_wake_pipe[2] = { -1, -1 };
+
+/* Xt inputs registered for fetcher sockets indexed by mask and fd */
+static XtInputId event_fetch_inputs[3][FD_SETSIZE];
+
+/* highest fetcher fd currently registered */
+static int event_fetch_maxfd = -1;
+
+/* set from the SIGUSR1 handler, statistics are written once awake */
+static volatile sig_atomic_t event_stats_requested = 0;
+
+static void event_stats_signal(int sig)
+{
+	event_stats_requested = 1;
+	motif_event_wake();
+}
+
+static void event_wake_input(XtPointer client_data, int *source, XtInputId *id)
+{
+	char buffer[64];
+
+	while (read(*source, buffer, sizeof(buffer)) > 0) {
+		/* drain every pending wakeup */
+	}
+
+	if (event_stats_requested) {
+		event_stats_requested = 0;
+		motif_schedule_stats_write();
+		motif_residency_log();
+	}
+
+	schedule_run();
+}
+
+static void event_fetch_input(XtPointer client_data, int *source, XtInputId *id)
+{
+	/* Nothing to do here; returning to the loop calls fetch_fdset()
+	 * which polls the fetchers before collecting their sockets.
+	 */
+}
+
+/**
+ * Bring the registered Xt inputs in line with the fetcher sockets.
+ */
+static void event_sync_fetch(void)
+{
+	static const XtPointer event_masks[3] = {
+		(XtPointer)XtInputReadMask,
+		(XtPointer)XtInputWriteMask,
+		(XtPointer)XtInputExceptMask
+	};
+	fd_set sets[3];
+	int maxfd = -1;
+	int limit;
+	int fd;
+	int set;
+
+	FD_ZERO(&sets[EVENT_FD_READ]);
+	FD_ZERO(&sets[EVENT_FD_WRITE]);
+	FD_ZERO(&sets[EVENT_FD_EXCEPT]);
+
+	fetch_fdset(&sets[EVENT_FD_READ],
+		    &sets[EVENT_FD_WRITE],
+		    &sets[EVENT_FD_EXCEPT],
+		    &maxfd);
+
+	if (maxfd >= FD_SETSIZE) {
+		NSLOG(netsurf, INFO, "fetcher fd %d beyond FD_SETSIZE", maxfd);
+		maxfd = FD_SETSIZE - 1;
+	}
+
+	limit = (maxfd > event_fetch_maxfd) ? maxfd : event_fetch_maxfd;
+
+	for (fd = 0; fd <= limit; fd++) {
+		for (set = 0; set < 3; set++) {
+			bool wanted = (fd <= maxfd) && FD_ISSET(fd, &sets[set]);
+			XtInputId *id = &event_fetch_inputs[set][fd];
+
+			if (wanted && (*id == 0)) {
+				*id = XtAppAddInput(event_app, fd,
+						    event_masks[set],
+						    event_fetch_input, NULL);
+			} else if (!wanted && (*id != 0)) {
+				XtRemoveInput(*id);
+				*id = 0;
+			}
+		}
+	}
+
+	event_fetch_maxfd = maxfd;
+}
+
+/* exported function documented in motif/event.h */
+nserror motif_event_init(XtAppContext app)
+{
+	struct sigaction sa;
+	int idx;
+
+	event_app = app;
+
+	if (pipe(event_wake_pipe) != 0) {
+		NSLOG(netsurf, INFO, "Unable to create wake pipe");
+		event_wake_pipe[0] = event_wake_pipe[1] = -1;
+		return NSERROR_INIT_FAILED;
+	}
+
+	for (idx = 0; idx < 2; idx++) {
+		fcntl(event_wake_pipe[idx], F_SETFL,
+		      fcntl(event_wake_pipe[idx], F_GETFL) | O_NONBLOCK);
+		fcntl(event_wake_pipe[idx], F_SETFD, FD_CLOEXEC);
+	}
+
+	XtAppAddInput(app, event_wake_pipe[0],
+		      (XtPointer)XtInputReadMask,
+		      event_wake_input, NULL);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = event_stats_signal;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &sa, NULL);
+
+	return NSERROR_OK;
+}
+
+/* exported function documented in motif/event.h */
+void motif_event_run(void)
+{
+	XtInputMask pending;
+
+	while (!XtAppGetExitFlag(event_app)) {
+		motif_watchdog_enter("fetcher poll", "fetch_fdset", NULL);
+		event_sync_fetch();
+		motif_watchdog_leave();
+
+		/* Xt dispatches expired timers ahead of queued X events,
+		 * so service input first; scheduled callbacks deferred
+		 * by an exhausted budget then wait behind it.
+		 */
+		pending = XtAppPending(event_app);
+		if (pending & XtIMXEvent) {
+			XtAppProcessEvent(event_app, XtIMXEvent);
+		} else if ((pending == 0) &&
+			   (event_fetch_maxfd < 0) &&
+			   !motif_schedule_idle_pending() &&
+			   motif_schedule_advance()) {
+			/* nothing in flight, the virtual clock moved on */
+		} else {
+			XtAppProcessEvent(event_app, XtIMAll);
+		}
+	}
+}
+
+/* exported function documented in motif/event.h */
+void motif_event_wake(void)
+{
+	int saved_errno = errno;
+	char c = 0;
+
+	if ((event_wake_pipe[1] != -1) &&
+	    (write(event_wake_pipe[1], &c, 1) < 0)) {
+		/* a full pipe already has a wakeup pending */
+	}
+
+	errno = saved_errno;
+}
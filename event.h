@@ -0,0 +1,51 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NETSURF_MOTIF_EVENT_H
+#define NETSURF_MOTIF_EVENT_H
+
+#include <X11/Intrinsic.h>
+
+/**
+ * Initialise the main event loop.
+ *
+ * Creates the wake pipe and registers it with the application context.
+ * SIGUSR1 is handled by writing the scheduler statistics.
+ *
+ * \param app The application context the loop dispatches.
+ * \return NSERROR_OK on success or error code on faliure.
+ */
+nserror motif_event_init(XtAppContext app);
+
+/**
+ * Run the main event loop until the application exit flag is set.
+ *
+ * The loop waits on the X connection, the core fetcher sockets and
+ * the wake pipe together and dispatches whichever becomes ready.
+ */
+void motif_event_run(void);
+
+/**
+ * Wake the main event loop.
+ *
+ * Safe to call from other threads and from signal handlers. Expired
+ * scheduled callbacks are run once the loop wakes.
+ */
+void motif_event_wake(void);
+
+#endif
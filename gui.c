@@ -67,6 +67,11 @@
 #include "motif/gui.h"
 #include "motif/drawing.h"
 #include "motif/schedule.h"
+#include "motif/event.h"
+#include "motif/threadpool.h"
+#include "motif/watchdog.h"
+#include "motif/tilecache.h"
+#include "motif/swizzle.h"
 #include "motif/findfile.h"
 #include "motif/font.h"
 #include "motif/clipboard.h"
@@ -157,6 +162,11 @@ static struct gui_drag {
 } gui_drag;
 
 void drawingAreaRedrawCallback(Widget widget, XtPointer client_data, XtPointer call_data);
+static void gui_window_scrolled(struct gui_window *gw);
+static nserror gui_window_invalidate_area(struct gui_window *g, const struct rect *rect);
+#ifndef NSMOTIF_USE_GL
+static void gui_window_repaint(struct gui_window *gw, const struct rect *clip);
+#endif
 
 void setupBookmarksMenu();
 static void setupTabs();
@@ -223,7 +233,7 @@ widget_scroll_y(struct gui_window *gw, int y, bool abs)
 
 	XtVaSetValues(gw->vertScrollBar, XmNvalue, scrollY, NULL);
 
-	drawingAreaRedrawCallback(gw->drawingArea, NULL, NULL);
+	gui_window_scrolled(gw);
 }
 
 /* queue a window scroll */
@@ -250,7 +260,7 @@ widget_scroll_x(struct gui_window *gw, int x, bool abs)
 
 	XtVaSetValues(gw->horizScrollBar, XmNvalue, scrollX, NULL);
 
-	drawingAreaRedrawCallback(gw->drawingArea, NULL, NULL);
+	gui_window_scrolled(gw);
 }
 
 void scrollbarChangedCallback(Widget widget, XtPointer client_data, XtPointer call_data)
@@ -262,7 +272,7 @@ void scrollbarChangedCallback(Widget widget, XtPointer client_data, XtPointer ca
 		return;
 	}
 
-	drawingAreaRedrawCallback(gw->drawingArea, NULL, NULL);
+	gui_window_scrolled(gw);
 }
 
 void drawingAreaResizeCallback(Widget widget, XtPointer client_data, XtPointer call_data)
@@ -274,6 +284,12 @@ void drawingAreaResizeCallback(Widget widget, XtPointer client_data, XtPointer c
 		return;
 	}
 
+	// The window contents no longer match the new size
+	gw->backValid = false;
+	if(gw->tiles != NULL) {
+		motif_tilecache_invalidate(gw->tiles, NULL);
+	}
+
 #ifdef NSMOTIF_USE_GL
 	Dimension width, height;
 	XtVaGetValues(widget, XmNwidth, &width, XmNheight, &height, NULL);
@@ -373,6 +389,7 @@ void tabExposeCallback(Widget widget, XtPointer client_data, XtPointer call_data
 	XSetForeground(motifDisplay, gw->gc, gw==currentTab?colorc4c4c4:color808080);
 	XSetFillStyle(motifDisplay, gw->gc, FillSolid);
 	XFillRectangle(motifDisplay, XtWindow(widget), gw->gc, 0, 0, width, height);
+	fb_plot_gc_changed(gw);
 
 }
 
@@ -425,6 +442,200 @@ void motifStopReloadButtonCallback(Widget widget, XtPointer client_data, XtPoint
 	browser_window_stop(gw->bw);
 }
 
+/**
+ * Track how much of a drawing area is visible and queue redraws for
+ * the parts a scroll could not copy because they were obscured.
+ */
+static void
+drawingAreaEventHandler(Widget widget, XtPointer client_data, XEvent *event, Boolean *cont)
+{
+	struct gui_window *gw = (struct gui_window *)client_data;
+
+	if(event->type == VisibilityNotify) {
+		gw->visibility = event->xvisibility.state;
+	} else if(event->type == GraphicsExpose) {
+		struct rect r;
+#ifndef NSMOTIF_USE_GL
+		// The page did not change, so the tiles still hold the area
+		r.x0 = event->xgraphicsexpose.x;
+		r.y0 = event->xgraphicsexpose.y;
+		r.x1 = r.x0 + event->xgraphicsexpose.width;
+		r.y1 = r.y0 + event->xgraphicsexpose.height;
+		gui_window_repaint(gw, &r);
+#else
+		int scrollX, scrollY;
+
+		XtVaGetValues(gw->horizScrollBar, XmNvalue, &scrollX, NULL);
+		XtVaGetValues(gw->vertScrollBar, XmNvalue, &scrollY, NULL);
+
+		r.x0 = event->xgraphicsexpose.x + scrollX;
+		r.y0 = event->xgraphicsexpose.y + scrollY;
+		r.x1 = r.x0 + event->xgraphicsexpose.width;
+		r.y1 = r.y0 + event->xgraphicsexpose.height;
+		gui_window_invalidate_area(gw, &r);
+#endif
+	}
+}
+
+#ifndef NSMOTIF_USE_GL
+/**
+ * Make sure a window has a back buffer the size of its drawing area.
+ *
+ * \param gw The window being redrawn.
+ * \param width The drawing area width.
+ * \param height The drawing area height.
+ * \return true if the back buffer can be plotted into.
+ */
+static bool
+gui_window_back_buffer(struct gui_window *gw, int width, int height)
+{
+	if((gw->backBuffer != None) && (gw->backWidth == width) && (gw->backHeight == height)) {
+		return true;
+	}
+
+	if(gw->backBuffer != None) {
+		XFreePixmap(motifDisplay, gw->backBuffer);
+		gw->backBuffer = None;
+	}
+	gw->backValid = false;
+
+	if((width <= 0) || (height <= 0)) {
+		return false;
+	}
+
+	gw->backBuffer = XCreatePixmap(motifDisplay, XtWindow(gw->drawingArea), width, height, motifDepth);
+	gw->backWidth = width;
+	gw->backHeight = height;
+
+	/* presenting never copies from the window so needs no exposures */
+	XSetGraphicsExposures(motifDisplay, gw->gc, False);
+
+	return gw->backBuffer != None;
+}
+
+/**
+ * Copy an area of the back buffer onto the window.
+ *
+ * \param gw The window to present.
+ * \param clip The area to copy in window coordinates.
+ */
+static void
+gui_window_present(struct gui_window *gw, const struct rect *clip)
+{
+	if((clip->x1 <= clip->x0) || (clip->y1 <= clip->y0)) {
+		return;
+	}
+
+	/* the plotters leave their last clip rectangle on the gc */
+	fb_plot_unclip(gw);
+	XCopyArea(motifDisplay, gw->backBuffer, XtWindow(gw->drawingArea), gw->gc,
+			clip->x0, clip->y0,
+			clip->x1 - clip->x0, clip->y1 - clip->y0,
+			clip->x0, clip->y0);
+}
+#endif
+
+/**
+ * Render part of a window, through its tile cache when it has one.
+ *
+ * \param gw The window being redrawn.
+ * \param scrollX Horizontal scroll offset.
+ * \param scrollY Vertical scroll offset.
+ * \param clip The area to render in window coordinates.
+ * \param ctx The redraw context.
+ */
+static void
+gui_window_redraw_clip(struct gui_window *gw, int scrollX, int scrollY, const struct rect *clip, const struct redraw_context *ctx)
+{
+#ifndef NSMOTIF_USE_GL
+	if(gw->tiles != NULL) {
+		motif_tilecache_redraw(gw->tiles, gw,
+				(gw->backBuffer != None) ? gw->backBuffer : XtWindow(gw->drawingArea),
+				scrollX, scrollY, clip);
+		return;
+	}
+#endif
+
+	browser_window_redraw(gw->bw,
+			-scrollX,
+			-scrollY,
+			clip, ctx);
+}
+
+/**
+ * Draw the caret of a window if it has one.
+ *
+ * Tiles are rendered with their own clip, so the clip of the area
+ * being redrawn is set again first.
+ *
+ * \param gw The window being redrawn.
+ * \param scrollX Horizontal scroll offset.
+ * \param scrollY Vertical scroll offset.
+ * \param clip The area being redrawn in window coordinates.
+ * \param ctx The redraw context.
+ */
+static void
+gui_window_draw_caret(struct gui_window *gw, int scrollX, int scrollY, const struct rect *clip, const struct redraw_context *ctx)
+{
+	plot_style_t style;
+	struct rect line;
+
+	if(!gw->caretEnabled) {
+		return;
+	}
+
+	style.stroke_type = PLOT_OP_TYPE_SOLID;
+	style.stroke_colour = 0xffff00ff;
+	style.stroke_width = plot_style_int_to_fixed(2);
+
+	line.x0 = gw->caretX-scrollX;
+	line.y0 = gw->caretY-scrollY;
+	line.x1 = gw->caretX-scrollX;
+	line.y1 = gw->caretY+gw->caretH-scrollY;
+
+	ctx->plot->clip(ctx, clip);
+	ctx->plot->line(ctx, &style, &line);
+}
+
+#ifndef NSMOTIF_USE_GL
+/**
+ * Repaint part of a window whose content has not changed.
+ *
+ * Used for the areas a scroll could not copy because they were
+ * obscured. They are copied from the tiles when the window has them,
+ * nothing is invalidated.
+ *
+ * \param gw The window.
+ * \param clip The area to repaint in window coordinates.
+ */
+static void
+gui_window_repaint(struct gui_window *gw, const struct rect *clip)
+{
+	struct redraw_context ctx = {
+		.interactive = true,
+		.background_images = true,
+		.plot = &fb_plotters,
+		.priv = gw
+	};
+	int scrollX, scrollY;
+
+	if(gw != currentTab) {
+		return;
+	}
+
+	motif_watchdog_enter("redraw", __func__, NULL);
+
+	XtVaGetValues(gw->horizScrollBar, XmNvalue, &scrollX, NULL);
+	XtVaGetValues(gw->vertScrollBar, XmNvalue, &scrollY, NULL);
+
+	gui_window_redraw_clip(gw, scrollX, scrollY, clip, &ctx);
+	gui_window_draw_caret(gw, scrollX, scrollY, clip, &ctx);
+	fb_plot_flush();
+
+	motif_watchdog_leave();
+}
+#endif
+
 void drawingAreaRedrawCallback(Widget widget, XtPointer client_data, XtPointer call_data)
 {
 	Dimension width, height;
@@ -432,6 +643,7 @@ void drawingAreaRedrawCallback(Widget widget, XtPointer client_data, XtPointer c
 	int x;
 	int y;
 	struct rect clip;
+	bool buffered = false;
 
 	struct gui_window *gw;
 	XtVaGetValues(widget, XmNuserData, &gw, NULL);
@@ -444,6 +656,8 @@ void drawingAreaRedrawCallback(Widget widget, XtPointer client_data, XtPointer c
 		return;
 	}
 
+	motif_watchdog_enter("Xt callback", __func__, NULL);
+
 #ifdef NSMOTIF_USE_GL
 	glXMakeCurrent(motifDisplay, XtWindow(gw->drawingArea), motifGLContext);
 #endif
@@ -481,37 +695,53 @@ void drawingAreaRedrawCallback(Widget widget, XtPointer client_data, XtPointer c
 		clip.y1 = clip.y0 + event->xexpose.height;
 	}
 
-	browser_window_redraw(gw->bw,
-			-scrollX,
-			-scrollY,
-			&clip, &ctx);
+#ifndef NSMOTIF_USE_GL
+	buffered = gui_window_back_buffer(gw, width, height);
+	if(buffered) {
+		if(gw->backValid && (gw->backScrollX == scrollX) && (gw->backScrollY == scrollY)) {
+			if(event) {
+				/* Uncovered by another window, the back
+				 * buffer still holds what was there.
+				 */
+				gui_window_present(gw, &clip);
+				motif_watchdog_leave();
+				return;
+			}
+		} else {
+			clip.x0 = 0;
+			clip.y0 = 0;
+			clip.x1 = width;
+			clip.y1 = height;
+		}
+		fb_plot_set_target(gw->backBuffer);
+	}
+#endif
 
-	if(gw->caretEnabled) {
-		plot_style_t style;
-		struct rect line;
+	gui_window_redraw_clip(gw, scrollX, scrollY, &clip, &ctx);
 
-		style.stroke_type = PLOT_OP_TYPE_SOLID;
-		style.stroke_colour = 0xffff00ff;
-		style.stroke_width = plot_style_int_to_fixed(2);
+	gui_window_draw_caret(gw, scrollX, scrollY, &clip, &ctx);
 
-		line.x0 = gw->caretX-scrollX;
-		line.y0 = gw->caretY-scrollY;
-		line.x1 = gw->caretX-scrollX;
-		line.y1 = gw->caretY+gw->caretH-scrollY;
+	if(buffered || ((clip.x0 <= 0) && (clip.y0 <= 0) && (clip.x1 >= width) && (clip.y1 >= height))) {
+		gw->backValid = true;
+		gw->backScrollX = scrollX;
+		gw->backScrollY = scrollY;
+	}
 
-#ifdef NSMOTIF_USE_GL
-		motifgl_plotters
-#else
-		fb_plotters
-#endif
-			.line(&ctx, &style, &line);
+#ifndef NSMOTIF_USE_GL
+	fb_plot_flush();
+	if(buffered) {
+		fb_plot_set_target(None);
+		gui_window_present(gw, &clip);
 	}
+#endif
 
 #ifdef NSMOTIF_USE_GL
 	if(motifDoubleBuffered) {
 		glXSwapBuffers(motifDisplay, XtWindow(gw->drawingArea));
 	}
 #endif
+
+	motif_watchdog_leave();
 }
 
 void drawingAreaInputCallback(Widget widget, XtPointer client_data, XtPointer call_data)
@@ -770,6 +1000,12 @@ static void gui_quit(void)
 	urldb_save_cookies(nsoption_charp(cookie_jar));
 	urldb_save(nsoption_charp(url_file));
 	hotlist_fini();
+
+	motif_pool_fini();
+
+	if (nsoption_charp(motif_schedule_stats_file) != NULL) {
+		motif_schedule_stats_write();
+	}
 }
 
 /* called back when click in browser window */
@@ -1390,6 +1626,7 @@ create_normal_browser_window(struct gui_window *gw)
 	XtAddCallback(gw->drawingArea, XmNexposeCallback, drawingAreaRedrawCallback, NULL);
 	XtAddCallback(gw->drawingArea, XmNresizeCallback, drawingAreaResizeCallback, NULL);
 	XtAddCallback(gw->drawingArea, XmNinputCallback, drawingAreaInputCallback, NULL);
+	XtAddEventHandler(gw->drawingArea, VisibilityChangeMask, True, drawingAreaEventHandler, gw);
 
 	XtAddCallback(gw->vertScrollBar, XmNvalueChangedCallback, scrollbarChangedCallback, NULL);
 	XtAddCallback(gw->horizScrollBar, XmNvalueChangedCallback, scrollbarChangedCallback, NULL);
@@ -1511,6 +1748,12 @@ gui_window_create(struct browser_window *bw,
 	gw->bw = bw;
 	gw->tabTitle = strdup("");
 
+#ifndef NSMOTIF_USE_GL
+	if(nsoption_int(motif_tile_cache_size) > 0) {
+		gw->tiles = motif_tilecache_create();
+	}
+#endif
+
 	create_normal_browser_window(gw);
 
 	/* Add it to the window list */
@@ -1526,7 +1769,14 @@ gui_window_destroy(struct gui_window *gw)
 
 	gui_window_remove_from_window_list(gw);
 
+	fb_plot_gc_changed(gw);
 	XFreeGC(XtDisplay(gw->drawingArea), gw->gc);
+	if(gw->backBuffer != None) {
+		XFreePixmap(XtDisplay(gw->drawingArea), gw->backBuffer);
+	}
+	if(gw->tiles != NULL) {
+		motif_tilecache_destroy(gw->tiles);
+	}
 
 	XtUnmanageChild(gw->layout);
 	XtUnmanageChild(gw->tab);
@@ -1556,6 +1806,8 @@ void scheduled_redraw(void *arg) {
 	int x;
 	int y;
 	struct rect clip;
+	int rectCount;
+	bool buffered = false;
 
 	struct gui_window *gw = ScheduledRedrawData.gw;
 	if(!gw) {
@@ -1566,6 +1818,8 @@ void scheduled_redraw(void *arg) {
 		return;
 	}
 
+	motif_watchdog_enter("redraw", __func__, NULL);
+
 	struct redraw_context ctx = {
 		.interactive = true,
 		.background_images = true,
@@ -1581,6 +1835,16 @@ void scheduled_redraw(void *arg) {
 	XtVaGetValues(gw->horizScrollBar, XmNvalue, &scrollX, NULL);
 	XtVaGetValues(gw->vertScrollBar, XmNvalue, &scrollY, NULL);
 
+#ifndef NSMOTIF_USE_GL
+	buffered = gui_window_back_buffer(gw, width, height);
+	if(buffered) {
+		if(!gw->backValid || (gw->backScrollX != scrollX) || (gw->backScrollY != scrollY)) {
+			ScheduledRedrawData.fullWindow = 1;
+		}
+		fb_plot_set_target(gw->backBuffer);
+	}
+#endif
+
 	if(ScheduledRedrawData.fullWindow || motifDoubleBuffered) {
 		ScheduledRedrawData.r[0].x0 = 0;
 		ScheduledRedrawData.r[0].y0 = 0;
@@ -1602,42 +1866,190 @@ void scheduled_redraw(void *arg) {
 
 //printf("Scheduled redraw %d,%d -> %d,%d in %dx%d window\n", data->r.x0, data->r.y0, data->r.x1, data->r.y1, (int)width, (int)height);
 
-		browser_window_redraw(gw->bw,
-			-scrollX,
-			-scrollY,
-			&clip, &ctx);
+		gui_window_redraw_clip(gw, scrollX, scrollY, &clip, &ctx);
 	}
 
+	rectCount = ScheduledRedrawData.rectCount;
+	if(buffered || ScheduledRedrawData.fullWindow || motifDoubleBuffered) {
+		gw->backValid = true;
+		gw->backScrollX = scrollX;
+		gw->backScrollY = scrollY;
+	}
 	ScheduledRedrawData.rectCount = 0;
 	ScheduledRedrawData.scheduled = 0;
 	ScheduledRedrawData.fullWindow = 0;
 
-	if(gw->caretEnabled) {
-		plot_style_t style;
-		struct rect line;
+	clip.x0 = 0;
+	clip.y0 = 0;
+	clip.x1 = width;
+	clip.y1 = height;
+	gui_window_draw_caret(gw, scrollX, scrollY, &clip, &ctx);
+
+#ifndef NSMOTIF_USE_GL
+	fb_plot_flush();
+	if(buffered) {
+		fb_plot_set_target(None);
+		for(int i = 0; i < rectCount; i++) {
+			gui_window_present(gw, &ScheduledRedrawData.r[i]);
+		}
+	}
+#endif
+
+#ifdef NSMOTIF_USE_GL
+	if(motifDoubleBuffered) {
+		glXSwapBuffers(motifDisplay, XtWindow(gw->drawingArea));
+	}
+#endif
+
+	motif_watchdog_leave();
+}
+
+/**
+ * Redraw a window after its scroll offsets changed.
+ *
+ * The part of the previous view which is still visible is moved with
+ * a copy and only the bands it uncovers are rendered. Anything which
+ * cannot be reused gets a full redraw instead.
+ *
+ * \param gw The window which scrolled.
+ */
+static void
+gui_window_scrolled(struct gui_window *gw)
+{
+	Dimension width, height;
+	int scrollX, scrollY;
+	int dx, dy;
+	int srcX, srcY, dstX, dstY;
+	int copyW, copyH;
+	struct rect bands[2];
+	struct rect all;
+	int bandCount = 0;
+
+	if(gw != currentTab) {
+		return;
+	}
+
+	XtVaGetValues(gw->drawingArea, XmNwidth, &width, XmNheight, &height, NULL);
+	XtVaGetValues(gw->horizScrollBar, XmNvalue, &scrollX, NULL);
+	XtVaGetValues(gw->vertScrollBar, XmNvalue, &scrollY, NULL);
+
+	dx = scrollX - gw->backScrollX;
+	dy = scrollY - gw->backScrollY;
+
+	if(!gw->backValid || (abs(dx) >= width) || (abs(dy) >= height)
+#ifdef NSMOTIF_USE_GL
+	   // GL cannot copy what another window is covering
+	   || (gw->visibility != VisibilityUnobscured)
+#else
+	   || ((gw->backBuffer != None) && ((gw->backWidth != width) || (gw->backHeight != height)))
+#endif
+	   ) {
+		drawingAreaRedrawCallback(gw->drawingArea, NULL, NULL);
+		return;
+	}
 
-		style.stroke_type = PLOT_OP_TYPE_SOLID;
-		style.stroke_colour = 0xffff00ff;
-		style.stroke_width = plot_style_int_to_fixed(2);
+	if((dx == 0) && (dy == 0)) {
+		return;
+	}
 
-		line.x0 = gw->caretX-scrollX;
-		line.y0 = gw->caretY-scrollY;
-		line.x1 = gw->caretX-scrollX;
-		line.y1 = gw->caretY+gw->caretH-scrollY;
+	motif_watchdog_enter("redraw", __func__, NULL);
+
+	srcX = (dx > 0) ? dx : 0;
+	srcY = (dy > 0) ? dy : 0;
+	dstX = (dx > 0) ? 0 : -dx;
+	dstY = (dy > 0) ? 0 : -dy;
+	copyW = width - abs(dx);
+	copyH = height - abs(dy);
+
+	if(dy != 0) {
+		bands[bandCount].x0 = 0;
+		bands[bandCount].x1 = width;
+		bands[bandCount].y0 = (dy > 0) ? copyH : 0;
+		bands[bandCount].y1 = (dy > 0) ? height : -dy;
+		bandCount++;
+	}
+	if(dx != 0) {
+		bands[bandCount].x0 = (dx > 0) ? copyW : 0;
+		bands[bandCount].x1 = (dx > 0) ? width : -dx;
+		bands[bandCount].y0 = dstY;
+		bands[bandCount].y1 = dstY + copyH;
+		bandCount++;
+	}
+
+	// Pending damage moves along with the contents
+	if((ScheduledRedrawData.gw == gw) && !ScheduledRedrawData.fullWindow) {
+		for(int i = 0; i < ScheduledRedrawData.rectCount; i++) {
+			ScheduledRedrawData.r[i].x0 -= dx;
+			ScheduledRedrawData.r[i].y0 -= dy;
+			ScheduledRedrawData.r[i].x1 -= dx;
+			ScheduledRedrawData.r[i].y1 -= dy;
+		}
+	}
+
+	struct redraw_context ctx = {
+		.interactive = true,
+		.background_images = true,
+#ifdef NSMOTIF_USE_GL
+		.plot = &motifgl_plotters,
+#else
+		.plot = &fb_plotters,
+#endif
+		.priv = gw
+	};
 
 #ifdef NSMOTIF_USE_GL
-		motifgl_plotters
+	glXMakeCurrent(motifDisplay, XtWindow(gw->drawingArea), motifGLContext);
+
+	// The front buffer holds what is on screen; with double
+	// buffering the copy lands in the back buffer for the swap.
+	glScissor(0, 0, width, height);
+	glDisable(GL_BLEND);
+	glPixelZoom(1.0f, 1.0f);
+	glReadBuffer(GL_FRONT);
+	glRasterPos3f((float)dstX, (float)(dstY + copyH), -2.0f);
+	glCopyPixels(srcX, height - (srcY + copyH), copyW, copyH, GL_COLOR);
+	glReadBuffer(motifDoubleBuffered ? GL_BACK : GL_FRONT);
+	glEnable(GL_BLEND);
 #else
-		fb_plotters
+	fb_plot_unclip(gw);
+	if(gw->backBuffer != None) {
+		XCopyArea(motifDisplay, gw->backBuffer, gw->backBuffer, gw->gc,
+				srcX, srcY, copyW, copyH, dstX, dstY);
+		fb_plot_set_target(gw->backBuffer);
+	} else {
+		// Obscured parts come back as GraphicsExpose events
+		XSetGraphicsExposures(motifDisplay, gw->gc, True);
+		XCopyArea(motifDisplay, XtWindow(gw->drawingArea), XtWindow(gw->drawingArea), gw->gc,
+				srcX, srcY, copyW, copyH, dstX, dstY);
+	}
 #endif
-			.line(&ctx, &style, &line);
+
+	for(int i = 0; i < bandCount; i++) {
+		gui_window_redraw_clip(gw, scrollX, scrollY, &bands[i], &ctx);
 	}
 
+	all.x0 = 0;
+	all.y0 = 0;
+	all.x1 = width;
+	all.y1 = height;
+	gui_window_draw_caret(gw, scrollX, scrollY, &all, &ctx);
+
+	gw->backScrollX = scrollX;
+	gw->backScrollY = scrollY;
+
 #ifdef NSMOTIF_USE_GL
 	if(motifDoubleBuffered) {
 		glXSwapBuffers(motifDisplay, XtWindow(gw->drawingArea));
 	}
+#else
+	fb_plot_flush();
+	if(gw->backBuffer != None) {
+		fb_plot_set_target(None);
+		gui_window_present(gw, &all);
+	}
 #endif
+
+	motif_watchdog_leave();
 }
 
 /**
@@ -1650,8 +2062,13 @@ void scheduled_redraw(void *arg) {
 static nserror
 gui_window_invalidate_area(struct gui_window *g, const struct rect *rect)
 {
+	if(g->tiles != NULL) {
+		motif_tilecache_invalidate(g->tiles, rect);
+	}
+
 	if(g != currentTab) {
-		// Not the current tab, do nada
+		// Not the current tab, redraw it in full once shown
+		g->backValid = false;
 		return NSERROR_OK;
 	}
 
@@ -1683,7 +2100,8 @@ gui_window_invalidate_area(struct gui_window *g, const struct rect *rect)
 
 	if(!ScheduledRedrawData.scheduled) {
 		ScheduledRedrawData.scheduled = 1;
-		motif_schedule(1, scheduled_redraw, NULL);
+		motif_schedule_class(1, SCHEDULE_CLASS_REDRAW,
+				     scheduled_redraw, NULL);
 	}
 
 	return NSERROR_OK;
@@ -1739,7 +2157,7 @@ gui_window_set_scroll(struct gui_window *gw, const struct rect *rect)
 	XtVaSetValues(gw->horizScrollBar, XmNvalue, scrollX, NULL);
 	XtVaSetValues(gw->vertScrollBar, XmNvalue, scrollY, NULL);
 
-	drawingAreaRedrawCallback(gw->drawingArea, NULL, NULL);
+	gui_window_scrolled(gw);
 
 	return NSERROR_OK;
 }
@@ -2053,14 +2471,6 @@ static struct gui_misc_table motif_misc_table = {
 	.quit = gui_quit,
 };
 
-static void scheduleTimerCallback(XtPointer clientData, XtIntervalId *timer)
-{
-	XtAppContext * app = (XtAppContext *)clientData;
-
-	schedule_run();
-	XtAppAddTimeOut(*app, 20, scheduleTimerCallback, app);
-}
-
 uint64_t timestamp() {
 	struct timeval tv;
 	gettimeofday(&tv, NULL);
@@ -2097,6 +2507,8 @@ static void mouseAction(Widget widget, XEvent *event, String *args, Cardinal *nu
 		return;
 	}
 
+	motif_watchdog_enter("Xt action", __func__, NULL);
+
 	if(!strcmp(args[0], "down"))
 	{
 		browser_window_mouse_click(gw->bw, BROWSER_MOUSE_PRESS_1, x, y);
@@ -2119,6 +2531,7 @@ static void mouseAction(Widget widget, XEvent *event, String *args, Cardinal *nu
 
 			/* Tell core */
 			browser_window_mouse_track(gw->bw, 0, x, y);
+			motif_watchdog_leave();
 			return;
 		}
 		/* This is a click;
@@ -2207,6 +2620,8 @@ static void mouseAction(Widget widget, XEvent *event, String *args, Cardinal *nu
 	} else {
 		// printf("mouseAction(%s)\n", args[0]);
 	}
+
+	motif_watchdog_leave();
 }
 
 void windowClosedCallback(Widget widget, XtPointer client_data, XtPointer call_data) {
@@ -2251,12 +2666,16 @@ void windowMenuSimpleCallback(Widget widget, XtPointer client_data, XtPointer ca
 			if(toClose->prev) {
 				activateTab(toClose->prev);
 				gui_window_remove_from_window_list(toClose);
-				motif_schedule(100, scheduled_browser_destroy, toClose->bw);
+				motif_schedule_class(100, SCHEDULE_CLASS_BACKGROUND,
+						     scheduled_browser_destroy,
+						     toClose->bw);
 				//browser_window_destroy(toClose->bw);
 			} else if(toClose->next) {
 				activateTab(toClose->next);
 				gui_window_remove_from_window_list(toClose);
-				motif_schedule(100, scheduled_browser_destroy, toClose->bw);
+				motif_schedule_class(100, SCHEDULE_CLASS_BACKGROUND,
+						     scheduled_browser_destroy,
+						     toClose->bw);
 				//browser_window_destroy(toClose->bw);
 			} else {
 				// Quit the whole app
@@ -2530,6 +2949,21 @@ main(int argc, char** argv)
 		fprintf(stderr, "Message translations failed to load\n");
 	}
 
+	/* worker threads, jobs run inline if they cannot be started */
+	ret = motif_pool_init();
+	if (ret != NSERROR_OK) {
+		NSLOG(netsurf, INFO, "Worker threads failed to start");
+	}
+
+	ret = motif_watchdog_init();
+	if (ret != NSERROR_OK) {
+		NSLOG(netsurf, INFO, "Stall watchdog failed to start");
+	}
+
+	if (nsoption_bool(motif_swizzle_benchmark)) {
+		motif_swizzle_benchmark();
+	}
+
     XtSetLanguageProc(NULL, NULL, NULL);
     motifWindow = XtVaAppInitialize(&app, "netsurf-motif", NULL, 0, &argc, argv, fallbacks, NULL);
 	Widget mainWindow = XmCreateMainWindow(motifWindow, "main_window", NULL, 0);
@@ -2806,9 +3240,15 @@ printf("Selected GL visual id 0x%X depth %d\n", (int)vi->visualid, motifDepth);
 	if (ret != NSERROR_OK) {
 		fb_warn_user("Errorcode:", messages_get_errorcode(ret));
 	} else {
-		XtAppAddTimeOut(app, 20, scheduleTimerCallback, &app);
+		motif_schedule_init(app);
+		ret = motif_event_init(app);
+		if (ret != NSERROR_OK) {
+			/* worker threads could not wake the loop, run jobs inline */
+			NSLOG(netsurf, INFO, "Event wakeup failed to initialise");
+			motif_pool_fini();
+		}
 		activateTab(window_list);
-		XtAppMainLoop(app);
+		motif_event_run();
 	}
 
 	// Is this even necessary?
@@ -26,11 +26,30 @@
 /* bounding box */
 typedef struct nsfb_bbox_s bbox_t;
 
+/**
+ * GC values last sent by the X11 plotters.
+ *
+ * Values are only sent when they differ from these.
+ */
+struct motif_gc_state {
+	unsigned long known; /**< GC value mask of the fields below */
+	unsigned long foreground;
+	int fill_style;
+	Font font;
+	unsigned int line_width;
+	int line_style;
+	bool clip_rect; /**< clipped to clip, otherwise to clip_mask */
+	XRectangle clip;
+	Pixmap clip_mask;
+	int clip_x, clip_y; /**< clip origin */
+};
+
 struct gui_window {
 	// NOTE: These must be the first entries to match motif_corewindow 
 	// because I haven't yet abstracted this all out yet
 	Widget drawingArea;
 	GC gc;
+	struct motif_gc_state gcState; /**< values last sent on gc */
 
 	struct browser_window *bw;
 
@@ -54,6 +73,13 @@ struct gui_window {
 
 	int winWidth, winHeight;
 
+	Pixmap backBuffer; /**< off-screen copy of the window, X11 plotters only */
+	int backWidth, backHeight;
+	bool backValid; /**< window contents are current */
+	int backScrollX, backScrollY; /**< scroll offsets they were rendered at */
+	int visibility; /**< last VisibilityNotify state */
+	struct motif_tilecache *tiles; /**< rendered content, X11 plotters only */
+
 	struct gui_window *next;
 	struct gui_window *prev;
 };
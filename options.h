@@ -34,6 +34,39 @@ NSOPTION_STRING(fb_toolbar_layout, NULL)
 /** enable on screen keyboard */
 NSOPTION_BOOL(fb_osk, false)
 
+/***** scheduler options *****/
+
+/** milliseconds of scheduled work per main loop pass, 0 for no limit */
+NSOPTION_INTEGER(motif_schedule_budget, 10)
+/** file scheduler statistics are written to on SIGUSR1 and at exit */
+NSOPTION_STRING(motif_schedule_stats_file, NULL)
+/** run scheduled callbacks on a simulated clock for benchmarking */
+NSOPTION_BOOL(motif_virtual_clock, false)
+/** main loop stall reported by the watchdog in ms, 0 to disable */
+NSOPTION_INTEGER(motif_watchdog_ms, 100)
+
+/***** worker thread options *****/
+
+/** worker threads, 0 for one per processor, negative to run jobs inline */
+NSOPTION_INTEGER(motif_worker_threads, 0)
+
+/***** rendering options *****/
+
+/** kilobytes of rendered page tiles kept across all windows, 0 to disable */
+NSOPTION_INTEGER(motif_tile_cache_size, 16384)
+/** kilobytes of bitmaps scaled to their plotted size kept across all images */
+NSOPTION_INTEGER(motif_scaled_bitmap_cache_size, 8192)
+/** upload large images through MIT-SHM when the display is local */
+NSOPTION_BOOL(motif_shm_upload, true)
+/** composite images with XRender when the server supports it */
+NSOPTION_BOOL(motif_xrender, true)
+/** log timings of the pixel conversion kernels at startup */
+NSOPTION_BOOL(motif_swizzle_benchmark, false)
+/** kilobytes of image pixels kept in client memory before cold images are compressed, 0 for no limit */
+NSOPTION_INTEGER(motif_bitmap_client_budget, 131072)
+/** kilobytes of image pixmaps kept on the X server before cold images are released, 0 for no limit */
+NSOPTION_INTEGER(motif_bitmap_server_budget, 65536)
+
 /***** font options *****/
 
 /** render all fonts monochrome */
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Bitmap residency manager.
+ *
+ * The pixels of a bitmap are held in a client side buffer and in
+ * server side pixmaps, each tier with its own byte budget. Bitmaps are
+ * kept on a list in the order they were last plotted. When a tier goes
+ * over budget an idle task asks the least recently used bitmaps to
+ * demote themselves from it, they promote themselves again when next
+ * plotted.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "utils/log.h"
+#include "utils/errors.h"
+#include "utils/nsoption.h"
+
+#include "motif/schedule.h"
+#include "motif/residency.h"
+
+/* demotions made by each pass of the idle task */
+#define RESIDENCY_TRIM_CHUNK 8
+
+static const char *residency_tier_name[MOTIF_TIER_COUNT] = {
+	"client",
+	"server"
+};
+
+/* most and least recently used bitmaps */
+static struct motif_resident *residency_head = NULL;
+static struct motif_resident *residency_tail = NULL;
+
+static unsigned int residency_count = 0;
+static size_t residency_bytes[MOTIF_TIER_COUNT];
+static unsigned long residency_demoted[MOTIF_TIER_COUNT];
+static unsigned long residency_promoted[MOTIF_TIER_COUNT];
+
+/**
+ * Find the budget of a tier in bytes, 0 if it is unlimited.
+ */
+static size_t residency_budget(enum motif_tier tier)
+{
+	int kb;
+
+	if (tier == MOTIF_TIER_CLIENT) {
+		kb = nsoption_int(motif_bitmap_client_budget);
+	} else {
+		kb = nsoption_int(motif_bitmap_server_budget);
+	}
+
+	return (kb > 0) ? ((size_t)kb * 1024) : 0;
+}
+
+static bool residency_over(enum motif_tier tier)
+{
+	size_t budget = residency_budget(tier);
+
+	return (budget != 0) && (residency_bytes[tier] > budget);
+}
+
+static void residency_unlink(struct motif_resident *res)
+{
+	if (res->prev != NULL) {
+		res->prev->next = res->next;
+	} else {
+		residency_head = res->next;
+	}
+	if (res->next != NULL) {
+		res->next->prev = res->prev;
+	} else {
+		residency_tail = res->prev;
+	}
+	res->prev = res->next = NULL;
+}
+
+static void residency_push(struct motif_resident *res)
+{
+	res->prev = NULL;
+	res->next = residency_head;
+	if (residency_head != NULL) {
+		residency_head->prev = res;
+	} else {
+		residency_tail = res;
+	}
+	residency_head = res;
+}
+
+/**
+ * Idle task demoting the least recently used bitmaps of tiers over
+ * budget, a few at a time.
+ *
+ * \param p unused
+ * \return true once every tier fits or nothing more can be demoted
+ */
+static bool residency_trim(void *p)
+{
+	int remaining = RESIDENCY_TRIM_CHUNK;
+	int tier;
+
+	for (tier = 0; tier < MOTIF_TIER_COUNT; tier++) {
+		struct motif_resident *res = residency_tail;
+
+		while ((res != NULL) && (res != residency_head) &&
+		       residency_over(tier)) {
+			struct motif_resident *prev = res->prev;
+
+			if ((res->bytes[tier] > 0) && res->demote(res->pw, tier)) {
+				res->demoted |= 1u << tier;
+				residency_demoted[tier]++;
+				if (--remaining == 0) {
+					return false;
+				}
+			}
+			res = prev;
+		}
+	}
+
+	return true;
+}
+
+/* exported function documented in motif/residency.h */
+void motif_resident_add(struct motif_resident *res, bool (*demote)(void *pw, enum motif_tier tier), void *pw)
+{
+	int tier;
+
+	for (tier = 0; tier < MOTIF_TIER_COUNT; tier++) {
+		res->bytes[tier] = 0;
+	}
+	res->demoted = 0;
+	res->demote = demote;
+	res->pw = pw;
+
+	residency_push(res);
+	residency_count++;
+}
+
+/* exported function documented in motif/residency.h */
+void motif_resident_remove(struct motif_resident *res)
+{
+	int tier;
+
+	for (tier = 0; tier < MOTIF_TIER_COUNT; tier++) {
+		residency_bytes[tier] -= res->bytes[tier];
+		res->bytes[tier] = 0;
+	}
+
+	residency_unlink(res);
+	residency_count--;
+}
+
+/* exported function documented in motif/residency.h */
+void motif_resident_touch(struct motif_resident *res)
+{
+	if (residency_head != res) {
+		residency_unlink(res);
+		residency_push(res);
+	}
+}
+
+/* exported function documented in motif/residency.h */
+void motif_resident_set(struct motif_resident *res, enum motif_tier tier, size_t bytes)
+{
+	if ((res->demoted & (1u << tier)) && (bytes > res->bytes[tier])) {
+		res->demoted &= ~(1u << tier);
+		residency_promoted[tier]++;
+	}
+
+	residency_bytes[tier] = residency_bytes[tier] - res->bytes[tier] + bytes;
+	res->bytes[tier] = bytes;
+
+	if (residency_over(tier)) {
+		motif_schedule_idle(residency_trim, NULL);
+	}
+}
+
+/* exported function documented in motif/residency.h */
+void motif_residency_stats(struct motif_residency_stats *stats)
+{
+	int tier;
+
+	stats->count = residency_count;
+	for (tier = 0; tier < MOTIF_TIER_COUNT; tier++) {
+		stats->bytes[tier] = residency_bytes[tier];
+		stats->budget[tier] = residency_budget(tier);
+		stats->demoted[tier] = residency_demoted[tier];
+		stats->promoted[tier] = residency_promoted[tier];
+	}
+}
+
+/* exported function documented in motif/residency.h */
+void motif_residency_log(void)
+{
+	struct motif_residency_stats stats;
+	int tier;
+
+	motif_residency_stats(&stats);
+
+	NSLOG(netsurf, INFO, "%u bitmaps resident", stats.count);
+	for (tier = 0; tier < MOTIF_TIER_COUNT; tier++) {
+		NSLOG(netsurf, INFO,
+		      "%s tier: %zuKiB of %zuKiB, %lu demoted, %lu promoted",
+		      residency_tier_name[tier],
+		      stats.bytes[tier] / 1024, stats.budget[tier] / 1024,
+		      stats.demoted[tier], stats.promoted[tier]);
+	}
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset:8
+ * End:
+ */
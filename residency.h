@@ -0,0 +1,110 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NETSURF_MOTIF_RESIDENCY_H
+#define NETSURF_MOTIF_RESIDENCY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Places the pixels of a bitmap can be held.
+ */
+enum motif_tier {
+	MOTIF_TIER_CLIENT, /**< buffer in our address space */
+	MOTIF_TIER_SERVER, /**< pixmaps held by the X server */
+	MOTIF_TIER_COUNT
+};
+
+/**
+ * Residency of one bitmap, embedded in the bitmap.
+ */
+struct motif_resident {
+	struct motif_resident *prev; /**< more recently used */
+	struct motif_resident *next; /**< less recently used */
+	size_t bytes[MOTIF_TIER_COUNT]; /**< bytes held in each tier */
+	unsigned int demoted; /**< tiers demoted from since last grown */
+	/**
+	 * Release or shrink what is held in a tier.
+	 *
+	 * \return true if the tier was demoted.
+	 */
+	bool (*demote)(void *pw, enum motif_tier tier);
+	void *pw;
+};
+
+/**
+ * Residency totals across every bitmap.
+ */
+struct motif_residency_stats {
+	unsigned int count; /**< bitmaps tracked */
+	size_t bytes[MOTIF_TIER_COUNT]; /**< bytes held in each tier */
+	size_t budget[MOTIF_TIER_COUNT]; /**< budget of each tier, 0 if unlimited */
+	unsigned long demoted[MOTIF_TIER_COUNT]; /**< demotions made */
+	unsigned long promoted[MOTIF_TIER_COUNT]; /**< demoted bitmaps grown again */
+};
+
+/**
+ * Start tracking a bitmap as the most recently used.
+ *
+ * \param res The residency to track, holding nothing yet.
+ * \param demote Called to demote the bitmap from a tier.
+ * \param pw Passed to demote.
+ */
+void motif_resident_add(struct motif_resident *res, bool (*demote)(void *pw, enum motif_tier tier), void *pw);
+
+/**
+ * Stop tracking a bitmap, removing its bytes from the totals.
+ *
+ * \param res The residency to remove.
+ */
+void motif_resident_remove(struct motif_resident *res);
+
+/**
+ * Mark a bitmap as the most recently used.
+ *
+ * \param res The residency of the bitmap being plotted.
+ */
+void motif_resident_touch(struct motif_resident *res);
+
+/**
+ * Record the bytes a bitmap holds in a tier.
+ *
+ * Once a tier is over its budget the least recently used bitmaps are
+ * demoted from it when the main loop is next idle. The most recently
+ * used bitmap is never demoted.
+ *
+ * \param res The residency of the bitmap.
+ * \param tier The tier.
+ * \param bytes Bytes the bitmap now holds in the tier.
+ */
+void motif_resident_set(struct motif_resident *res, enum motif_tier tier, size_t bytes);
+
+/**
+ * Get the residency totals.
+ *
+ * \param stats Updated with the totals.
+ */
+void motif_residency_stats(struct motif_residency_stats *stats);
+
+/**
+ * Log the residency totals.
+ */
+void motif_residency_log(void);
+
+#endif
@@ -16,28 +16,657 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* dladdr() and Dl_info */
+#define _GNU_SOURCE
+
 #include <time.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <dlfcn.h>
 
 #include "utils/sys_time.h"
 #include "utils/log.h"
+#include "utils/nsoption.h"
+
+#include <X11/Intrinsic.h>
 
 #include "motif/schedule.h"
+#include "motif/event.h"
+#include "motif/watchdog.h"
+
+/* number of callback entries allocated at once when the free list is empty */
+#define SCHEDULE_POOL_CHUNK 64
+
+/* initial number of hash index buckets, must be a power of two */
+#define SCHEDULE_HASH_INITIAL 64
 
-/* linked list of scheduled callbacks */
-static struct nscallback *schedule_list = NULL;
+/* number of distinct callback functions tracked, must be a power of two */
+#define SCHEDULE_STATS_SIZE 256
+
+/* log2 histogram buckets, bucket n counts values below 2^n */
+#define SCHEDULE_STATS_BUCKETS 32
+
+/**
+ * Orders the callbacks of a class are kept in.
+ */
+enum schedule_order {
+	SCHEDULE_BY_LATEST, /**< end of the window, when the timer fires */
+	SCHEDULE_BY_OPENING, /**< start of the window, when it may run */
+	SCHEDULE_ORDER_COUNT
+};
 
 /**
  * scheduled callback.
  */
 struct nscallback
 {
-        struct nscallback *next;
-	struct timeval tv;
+	struct nscallback *next; /**< hash chain or free list link */
+	unsigned int heap_index[SCHEDULE_ORDER_COUNT]; /**< position in each class heap */
+	unsigned int seq; /**< insertion order, breaks deadline ties */
+	enum motif_schedule_class cls; /**< priority class */
+	struct timeval tv; /**< earliest time the callback may run */
+	struct timeval latest; /**< deadline plus slack, when the callback must run */
 	void (*callback)(void *p);
 	void *p;
 };
 
+/**
+ * Min-heaps of the callbacks in one priority class.
+ *
+ * Both heaps hold every callback of the class, one ordered on the end
+ * of each window and one on its start.
+ */
+struct schedule_queue {
+	struct nscallback **heap[SCHEDULE_ORDER_COUNT];
+	unsigned int count;
+	unsigned int size;
+
+	unsigned long run; /**< callbacks dispatched */
+	unsigned long deferred; /**< ticks that left due callbacks waiting */
+	unsigned long max_late; /**< worst lateness in microseconds */
+	unsigned long long total_late; /**< summed lateness in microseconds */
+};
+
+/**
+ * Idle task.
+ */
+struct nsidle {
+	struct nsidle *next;
+	bool (*task)(void *p);
+	void *p;
+};
+
+/**
+ * Log2 histogram of one measured quantity.
+ */
+struct schedule_histogram {
+	unsigned long long total;
+	unsigned long max;
+	unsigned long bucket[SCHEDULE_STATS_BUCKETS];
+};
+
+/**
+ * Statistics gathered for one callback function.
+ */
+struct schedule_stats {
+	void (*callback)(void *p); /**< callback function or NULL if unused */
+	unsigned long count; /**< invocations */
+	struct schedule_histogram late; /**< lateness in microseconds */
+	struct schedule_histogram runtime; /**< runtime in microseconds */
+	struct schedule_histogram depth; /**< callbacks queued at dispatch */
+};
+
+/* default slack of each class in ms */
+static const int schedule_class_slack[SCHEDULE_CLASS_COUNT] = {
+	4, /* redraw */
+	10, /* layout */
+	20, /* network */
+	100, /* background */
+};
+
+static const char *schedule_class_name[SCHEDULE_CLASS_COUNT] = {
+	"redraw",
+	"layout",
+	"network",
+	"background",
+};
+
+static struct schedule_queue schedule_queues[SCHEDULE_CLASS_COUNT];
+
+/* total callbacks scheduled over all classes */
+static unsigned int schedule_count = 0;
+
+/* hash index of scheduled callbacks keyed on (callback, p) */
+static struct nscallback **schedule_hash = NULL;
+static unsigned int schedule_hash_size = 0;
+
+/* recycled callback entries */
+static struct nscallback *schedule_free_list = NULL;
+
+/* insertion counter */
+static unsigned int schedule_seq = 0;
+
+/* Xt timer armed for the earliest deadline */
+static XtAppContext schedule_app = NULL;
+static XtIntervalId schedule_timer = 0;
+static struct timeval schedule_timer_tv;
+
+/* set while schedule_run() is dispatching callbacks */
+static bool schedule_running = false;
+
+/* callbacks posted from other threads, newest first */
+static struct motif_schedule_msg *schedule_posted = NULL;
+
+/* idle tasks, the head runs next */
+static struct nsidle *schedule_idle_list = NULL;
+
+/* idle task currently running and whether it was removed meanwhile */
+static struct nsidle *schedule_idle_current = NULL;
+static bool schedule_idle_removed = false;
+
+/* Xt work procedure running idle tasks */
+static XtWorkProcId schedule_idle_proc = 0;
+
+/* virtual clock in use instead of the time of day */
+static bool schedule_virtual = false;
+static struct timeval schedule_virtual_tv;
+
+/* set when the last schedule_run() ran out of budget */
+static bool schedule_deferred = false;
+
+/* per callback function statistics, open addressed on the function */
+static struct schedule_stats *schedule_stats = NULL;
+
+/* invocations of callbacks not tracked because the table was full */
+static unsigned long schedule_stats_dropped = 0;
+
+
+/**
+ * Read the scheduler clock.
+ *
+ * This is the time of day unless the virtual clock is in use, which
+ * only moves when motif_schedule_advance() is called.
+ */
+static inline void schedule_gettime(struct timeval *tv)
+{
+	if (schedule_virtual) {
+		*tv = schedule_virtual_tv;
+	} else {
+		gettimeofday(tv, NULL);
+	}
+}
+
+/**
+ * Compute the hash index bucket for a callback and context.
+ */
+static inline unsigned int
+schedule_hash_bucket(void (*callback)(void *p), void *p)
+{
+	uintptr_t h;
+
+	h = (uintptr_t)callback ^ ((uintptr_t)p * 0x9e3779b1u);
+	h ^= h >> 16;
+
+	return (unsigned int)h & (schedule_hash_size - 1);
+}
+
+/**
+ * Check if callback entry a comes before entry b in a heap order.
+ */
+static inline bool
+schedule_before(const struct nscallback *a,
+		const struct nscallback *b,
+		enum schedule_order order)
+{
+	const struct timeval *ta;
+	const struct timeval *tb;
+
+	if (order == SCHEDULE_BY_LATEST) {
+		ta = &a->latest;
+		tb = &b->latest;
+	} else {
+		ta = &a->tv;
+		tb = &b->tv;
+	}
+
+	if (timercmp(ta, tb, <)) {
+		return true;
+	}
+	if (timercmp(ta, tb, >)) {
+		return false;
+	}
+	/* unsigned difference keeps the order sane across wraparound */
+	return (int)(a->seq - b->seq) < 0;
+}
+
+static inline void
+schedule_heap_set(struct schedule_queue *q,
+		  enum schedule_order order,
+		  unsigned int idx,
+		  struct nscallback *nscb)
+{
+	q->heap[order][idx] = nscb;
+	nscb->heap_index[order] = idx;
+}
+
+static void
+schedule_heap_up(struct schedule_queue *q, enum schedule_order order, unsigned int idx)
+{
+	struct nscallback **heap = q->heap[order];
+	struct nscallback *nscb = heap[idx];
+
+	while (idx > 0) {
+		unsigned int parent = (idx - 1) / 2;
+		if (!schedule_before(nscb, heap[parent], order)) {
+			break;
+		}
+		schedule_heap_set(q, order, idx, heap[parent]);
+		idx = parent;
+	}
+	schedule_heap_set(q, order, idx, nscb);
+}
+
+static void
+schedule_heap_down(struct schedule_queue *q, enum schedule_order order, unsigned int idx)
+{
+	struct nscallback **heap = q->heap[order];
+	struct nscallback *nscb = heap[idx];
+
+	for (;;) {
+		unsigned int child = (idx * 2) + 1;
+		if (child >= q->count) {
+			break;
+		}
+		if ((child + 1 < q->count) &&
+		    schedule_before(heap[child + 1], heap[child], order)) {
+			child++;
+		}
+		if (!schedule_before(heap[child], nscb, order)) {
+			break;
+		}
+		schedule_heap_set(q, order, idx, heap[child]);
+		idx = child;
+	}
+	schedule_heap_set(q, order, idx, nscb);
+}
+
+/**
+ * Restore the heap orders after the window of an entry changed.
+ */
+static void schedule_heap_update(struct nscallback *nscb)
+{
+	struct schedule_queue *q = &schedule_queues[nscb->cls];
+	int order;
+
+	for (order = 0; order < SCHEDULE_ORDER_COUNT; order++) {
+		schedule_heap_up(q, order, nscb->heap_index[order]);
+		schedule_heap_down(q, order, nscb->heap_index[order]);
+	}
+}
+
+/**
+ * Add an entry to the heaps of its class.
+ */
+static nserror schedule_heap_insert(struct nscallback *nscb)
+{
+	struct schedule_queue *q = &schedule_queues[nscb->cls];
+	int order;
+
+	if (q->count == q->size) {
+		struct nscallback **heap;
+		unsigned int size;
+
+		size = (q->size == 0) ? SCHEDULE_POOL_CHUNK : q->size * 2;
+		for (order = 0; order < SCHEDULE_ORDER_COUNT; order++) {
+			heap = realloc(q->heap[order],
+				       size * sizeof(struct nscallback *));
+			if (heap == NULL) {
+				/* heaps already grown keep their size */
+				return NSERROR_NOMEM;
+			}
+			q->heap[order] = heap;
+		}
+		q->size = size;
+	}
+
+	for (order = 0; order < SCHEDULE_ORDER_COUNT; order++) {
+		schedule_heap_set(q, order, q->count, nscb);
+	}
+	q->count++;
+	schedule_count++;
+	for (order = 0; order < SCHEDULE_ORDER_COUNT; order++) {
+		schedule_heap_up(q, order, nscb->heap_index[order]);
+	}
+
+	return NSERROR_OK;
+}
+
+/**
+ * Remove an entry from the heaps of its class, keeping them ordered.
+ */
+static void schedule_heap_remove(struct nscallback *nscb)
+{
+	struct schedule_queue *q = &schedule_queues[nscb->cls];
+	int order;
+
+	q->count--;
+	schedule_count--;
+
+	for (order = 0; order < SCHEDULE_ORDER_COUNT; order++) {
+		struct nscallback **heap = q->heap[order];
+		unsigned int idx = nscb->heap_index[order];
+		struct nscallback *last;
+
+		if (idx == q->count) {
+			continue;
+		}
+
+		last = heap[q->count];
+		schedule_heap_set(q, order, idx, last);
+		if ((idx > 0) && schedule_before(last, heap[(idx - 1) / 2], order)) {
+			schedule_heap_up(q, order, idx);
+		} else {
+			schedule_heap_down(q, order, idx);
+		}
+	}
+}
+
+/**
+ * Find the entry of a class to run next among those whose window has
+ * opened.
+ *
+ * The most urgent entry runs first when its window has opened. An
+ * entry whose window opened behind it is found at the top of the
+ * opening order, so it shares this wakeup.
+ *
+ * \param q The class queue.
+ * \param tv The current scheduler time.
+ * \return The entry or NULL if none is due.
+ */
+static struct nscallback *
+schedule_due(struct schedule_queue *q, const struct timeval *tv)
+{
+	struct nscallback *nscb;
+
+	if (q->count == 0) {
+		return NULL;
+	}
+
+	nscb = q->heap[SCHEDULE_BY_LATEST][0];
+	if (timercmp(tv, &nscb->tv, >)) {
+		return nscb;
+	}
+
+	nscb = q->heap[SCHEDULE_BY_OPENING][0];
+	if (timercmp(tv, &nscb->tv, >)) {
+		return nscb;
+	}
+
+	return NULL;
+}
+
+/**
+ * Find the scheduled entry which must run first over all classes.
+ */
+static struct nscallback *schedule_earliest(void)
+{
+	struct nscallback *earliest = NULL;
+	int cls;
+
+	for (cls = 0; cls < SCHEDULE_CLASS_COUNT; cls++) {
+		struct schedule_queue *q = &schedule_queues[cls];
+		if ((q->count > 0) &&
+		    ((earliest == NULL) ||
+		     timercmp(&q->heap[SCHEDULE_BY_LATEST][0]->latest,
+			      &earliest->latest, <))) {
+			earliest = q->heap[SCHEDULE_BY_LATEST][0];
+		}
+	}
+	return earliest;
+}
+
+/**
+ * Double the number of hash buckets, relinking every scheduled entry.
+ */
+static nserror schedule_hash_grow(void)
+{
+	struct nscallback **old_hash = schedule_hash;
+	unsigned int old_size = schedule_hash_size;
+	unsigned int new_size;
+	unsigned int idx;
+
+	new_size = (old_size == 0) ? SCHEDULE_HASH_INITIAL : old_size * 2;
+	schedule_hash = calloc(new_size, sizeof(struct nscallback *));
+	if (schedule_hash == NULL) {
+		schedule_hash = old_hash;
+		return NSERROR_NOMEM;
+	}
+	schedule_hash_size = new_size;
+
+	for (idx = 0; idx < old_size; idx++) {
+		struct nscallback *nscb = old_hash[idx];
+		while (nscb != NULL) {
+			struct nscallback *next = nscb->next;
+			unsigned int bucket;
+			bucket = schedule_hash_bucket(nscb->callback, nscb->p);
+			nscb->next = schedule_hash[bucket];
+			schedule_hash[bucket] = nscb;
+			nscb = next;
+		}
+	}
+	free(old_hash);
+
+	return NSERROR_OK;
+}
+
+/**
+ * Find the scheduled entry for a callback and context.
+ *
+ * \param callback callback function
+ * \param p user parameter
+ * \param link_out updated with the chain link referencing the entry
+ * \return the entry or NULL if not scheduled
+ */
+static struct nscallback *
+schedule_find(void (*callback)(void *p), void *p, struct nscallback ***link_out)
+{
+	struct nscallback **link;
+
+	if (schedule_hash_size == 0) {
+		return NULL;
+	}
+
+	link = &schedule_hash[schedule_hash_bucket(callback, p)];
+	while (*link != NULL) {
+		if (((*link)->callback == callback) && ((*link)->p == p)) {
+			if (link_out != NULL) {
+				*link_out = link;
+			}
+			return *link;
+		}
+		link = &(*link)->next;
+	}
+	return NULL;
+}
+
+/**
+ * Get a callback entry from the free list, refilling it if required.
+ */
+static struct nscallback *schedule_alloc(void)
+{
+	struct nscallback *nscb;
+
+	if (schedule_free_list == NULL) {
+		struct nscallback *chunk;
+		int idx;
+
+		chunk = calloc(SCHEDULE_POOL_CHUNK, sizeof(struct nscallback));
+		if (chunk == NULL) {
+			return NULL;
+		}
+		for (idx = 0; idx < SCHEDULE_POOL_CHUNK; idx++) {
+			chunk[idx].next = schedule_free_list;
+			schedule_free_list = &chunk[idx];
+		}
+	}
+
+	nscb = schedule_free_list;
+	schedule_free_list = nscb->next;
+	nscb->next = NULL;
+
+	return nscb;
+}
+
+/**
+ * Unlink an entry from its heap and the hash index and recycle it.
+ */
+static void
+schedule_release(struct nscallback *nscb, struct nscallback **link)
+{
+	*link = nscb->next;
+	schedule_heap_remove(nscb);
+
+	nscb->callback = NULL;
+	nscb->p = NULL;
+	nscb->next = schedule_free_list;
+	schedule_free_list = nscb;
+}
+
+/**
+ * Add a value to a log2 histogram.
+ */
+static void
+schedule_histogram_add(struct schedule_histogram *hist, unsigned long value)
+{
+	unsigned int bucket = 0;
+	unsigned long v = value;
+
+	while ((v != 0) && (bucket < (SCHEDULE_STATS_BUCKETS - 1))) {
+		v >>= 1;
+		bucket++;
+	}
+
+	hist->bucket[bucket]++;
+	hist->total += value;
+	if (value > hist->max) {
+		hist->max = value;
+	}
+}
+
+/**
+ * Find the statistics entry for a callback function, creating it if required.
+ *
+ * \param callback callback function
+ * \return the entry or NULL if the table is full or cannot be allocated.
+ */
+static struct schedule_stats *schedule_stats_get(void (*callback)(void *p))
+{
+	unsigned int idx;
+	unsigned int probe;
+	uintptr_t h;
+
+	if (schedule_stats == NULL) {
+		schedule_stats = calloc(SCHEDULE_STATS_SIZE,
+					sizeof(struct schedule_stats));
+		if (schedule_stats == NULL) {
+			return NULL;
+		}
+	}
+
+	h = (uintptr_t)callback;
+	h ^= h >> 12;
+	idx = (unsigned int)h & (SCHEDULE_STATS_SIZE - 1);
+
+	for (probe = 0; probe < SCHEDULE_STATS_SIZE; probe++) {
+		struct schedule_stats *stats = &schedule_stats[idx];
+		if (stats->callback == callback) {
+			return stats;
+		}
+		if (stats->callback == NULL) {
+			stats->callback = callback;
+			return stats;
+		}
+		idx = (idx + 1) & (SCHEDULE_STATS_SIZE - 1);
+	}
+
+	return NULL;
+}
+
+/**
+ * Write a histogram as a JSON object.
+ */
+static void
+schedule_histogram_dump(FILE *fp,
+			const char *name,
+			const struct schedule_histogram *hist)
+{
+	unsigned int bucket;
+
+	fprintf(fp, "\"%s\": {\"total\": %llu, \"max\": %lu, \"log2\": [",
+		name, hist->total, hist->max);
+	for (bucket = 0; bucket < SCHEDULE_STATS_BUCKETS; bucket++) {
+		fprintf(fp, "%s%lu", (bucket == 0) ? "" : ", ",
+			hist->bucket[bucket]);
+	}
+	fprintf(fp, "]}");
+}
+
+static void schedule_timer_callback(XtPointer client_data, XtIntervalId *id)
+{
+	schedule_timer = 0;
+	schedule_run();
+}
+
+/**
+ * Ensure the Xt timer will fire no later than the earliest deadline.
+ *
+ * A timer armed for a later deadline is replaced, an earlier one is
+ * left alone as it simply finds nothing to run and re-arms. The timer
+ * is removed once nothing is scheduled. Callbacks left waiting by an
+ * exhausted budget get an immediate timer, the main loop services
+ * pending X events before it.
+ */
+static void schedule_arm(void)
+{
+	struct timeval tv;
+	struct timeval delta;
+	struct nscallback *nscb;
+	unsigned long ms = 0;
+
+	if ((schedule_app == NULL) || schedule_running || schedule_virtual) {
+		/* the event loop advances the virtual clock itself */
+		return;
+	}
+
+	nscb = schedule_earliest();
+	if (nscb == NULL) {
+		if (schedule_timer != 0) {
+			XtRemoveTimeOut(schedule_timer);
+			schedule_timer = 0;
+		}
+		return;
+	}
+
+	if (schedule_timer != 0) {
+		if (!timercmp(&nscb->latest, &schedule_timer_tv, <)) {
+			return;
+		}
+		XtRemoveTimeOut(schedule_timer);
+	}
+
+	gettimeofday(&tv, NULL);
+	if (timercmp(&nscb->latest, &tv, >)) {
+		/* round up so the timer never fires ahead of the deadline */
+		timersub(&nscb->latest, &tv, &delta);
+		ms = (delta.tv_sec * 1000) + ((delta.tv_usec + 999) / 1000);
+	}
+
+	schedule_timer_tv = nscb->latest;
+	schedule_timer = XtAppAddTimeOut(schedule_app, ms,
+					 schedule_timer_callback, NULL);
+}
+
 /**
  * Unschedule a callback.
  *
@@ -48,176 +677,632 @@ struct nscallback
  */
 static nserror schedule_remove(void (*callback)(void *p), void *p)
 {
-        struct nscallback *cur_nscb;
-        struct nscallback *prev_nscb;
-        struct nscallback *unlnk_nscb;
+	struct nscallback *nscb;
+	struct nscallback **link;
 
-	/* check there is something on the list to remove */
-        if (schedule_list == NULL) {
-                return NSERROR_OK;
+	/* uniqueness is enforced on insertion so there is at most one */
+	nscb = schedule_find(callback, p, &link);
+	if (nscb == NULL) {
+		return NSERROR_OK;
 	}
 
-	NSLOG(schedule, DEBUG, "removing %p, %p", callback, p);
+	NSLOG(schedule, DEBUG, "callback entry %p removing  %p(%p)",
+	      nscb, nscb->callback, nscb->p);
 
-        cur_nscb = schedule_list;
-        prev_nscb = NULL;
+	schedule_release(nscb, link);
+	schedule_arm();
 
-        while (cur_nscb != NULL) {
-                if ((cur_nscb->callback ==  callback) &&
-                    (cur_nscb->p ==  p)) {
-                        /* item to remove */
+	return NSERROR_OK;
+}
 
-                        NSLOG(schedule, DEBUG,
-			      "callback entry %p removing  %p(%p)",
-                             cur_nscb, cur_nscb->callback, cur_nscb->p);
+/**
+ * Set the run window of a callback entry.
+ *
+ * \param nscb The entry to update.
+ * \param tival interval before the callback should be made in ms
+ * \param slack further ms the callback may be delayed by
+ */
+static void schedule_set_window(struct nscallback *nscb, int tival, int slack)
+{
+	struct timeval tv;
 
-                        /* remove callback */
-                        unlnk_nscb = cur_nscb;
-                        cur_nscb = unlnk_nscb->next;
+	tv.tv_sec = tival / 1000; /* miliseconds to seconds */
+	tv.tv_usec = (tival % 1000) * 1000; /* remainder to microseconds */
 
-                        if (prev_nscb == NULL) {
-                                schedule_list = cur_nscb;
-                        } else {
-                                prev_nscb->next = cur_nscb;
-                        }
-                        free (unlnk_nscb);
-                } else {
-                        /* move to next element */
-                        prev_nscb = cur_nscb;
-                        cur_nscb = prev_nscb->next;
-                }
-        }
+	schedule_gettime(&nscb->tv);
+	timeradd(&nscb->tv, &tv, &nscb->tv);
 
-	return NSERROR_OK;
+	tv.tv_sec = slack / 1000;
+	tv.tv_usec = (slack % 1000) * 1000;
+	timeradd(&nscb->tv, &tv, &nscb->latest);
 }
 
-/* exported function documented in framebuffer/schedule.h */
-nserror motif_schedule(int tival, void (*callback)(void *p), void *p)
+/* exported function documented in motif/schedule.h */
+nserror
+motif_schedule_slack(int tival,
+		     int slack,
+		     enum motif_schedule_class cls,
+		     void (*callback)(void *p),
+		     void *p)
 {
 	struct nscallback *nscb;
-	struct timeval tv;
-	nserror ret;
-//printf("motif_schedule %d %x %x\n", tival, callback, p);
-	/* ensure uniqueness of the callback and context */
-	ret = schedule_remove(callback, p);
-	if ((tival < 0) || (ret != NSERROR_OK)) {
-//printf("returning because failed schedule_remove\n");
-		return ret;
+	struct nscallback **link;
+	unsigned int bucket;
+
+	if (tival < 0) {
+		return schedule_remove(callback, p);
+	}
+
+	if (slack < 0) {
+		slack = 0;
 	}
 
-	NSLOG(schedule, DEBUG, "Adding %p(%p) in %d", callback, p, tival);
+	NSLOG(schedule, DEBUG, "Adding %p(%p) in %d slack %d class %d",
+	      callback, p, tival, slack, cls);
 
-        tv.tv_sec = tival / 1000; /* miliseconds to seconds */
-        tv.tv_usec = (tival % 1000) * 1000; /* remainder to microseconds */
+	/* ensure uniqueness of the callback and context by moving any
+	 * existing entry to its new deadline and class
+	 */
+	nscb = schedule_find(callback, p, &link);
+	if (nscb != NULL) {
+		if (nscb->cls != cls) {
+			schedule_heap_remove(nscb);
+			schedule_set_window(nscb, tival, slack);
+			nscb->seq = schedule_seq++;
+			nscb->cls = cls;
+			if (schedule_heap_insert(nscb) != NSERROR_OK) {
+				/* entry is in no heap, drop it from the index */
+				*link = nscb->next;
+				nscb->next = schedule_free_list;
+				schedule_free_list = nscb;
+				return NSERROR_NOMEM;
+			}
+		} else {
+			schedule_set_window(nscb, tival, slack);
+			nscb->seq = schedule_seq++;
+			schedule_heap_update(nscb);
+		}
+		schedule_arm();
+		return NSERROR_OK;
+	}
 
-	nscb = calloc(1, sizeof(struct nscallback));
-	
-	gettimeofday(&nscb->tv, NULL);
-	timeradd(&nscb->tv, &tv, &nscb->tv);
+	if ((schedule_count >= schedule_hash_size) &&
+	    (schedule_hash_grow() != NSERROR_OK) &&
+	    (schedule_hash_size == 0)) {
+		return NSERROR_NOMEM;
+	}
+
+	nscb = schedule_alloc();
+	if (nscb == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	schedule_set_window(nscb, tival, slack);
 
 	nscb->callback = callback;
 	nscb->p = p;
+	nscb->seq = schedule_seq++;
+	nscb->cls = cls;
+
+	if (schedule_heap_insert(nscb) != NSERROR_OK) {
+		nscb->next = schedule_free_list;
+		schedule_free_list = nscb;
+		return NSERROR_NOMEM;
+	}
 
-        /* add to list front */
-        nscb->next = schedule_list;
-        schedule_list = nscb;
+	bucket = schedule_hash_bucket(callback, p);
+	nscb->next = schedule_hash[bucket];
+	schedule_hash[bucket] = nscb;
+
+	schedule_arm();
 
 	return NSERROR_OK;
 }
 
+/* exported function documented in motif/schedule.h */
+nserror
+motif_schedule_class(int tival,
+		     enum motif_schedule_class cls,
+		     void (*callback)(void *p),
+		     void *p)
+{
+	return motif_schedule_slack(tival, schedule_class_slack[cls],
+				    cls, callback, p);
+}
+
+/* exported function documented in framebuffer/schedule.h */
+nserror motif_schedule(int tival, void (*callback)(void *p), void *p)
+{
+	return motif_schedule_class(tival, SCHEDULE_CLASS_LAYOUT, callback, p);
+}
+
+/* exported function documented in motif/schedule.h */
+void motif_schedule_post(struct motif_schedule_msg *msg)
+{
+	struct motif_schedule_msg *head;
+
+	head = __atomic_load_n(&schedule_posted, __ATOMIC_RELAXED);
+	do {
+		msg->next = head;
+	} while (!__atomic_compare_exchange_n(&schedule_posted, &head, msg,
+					      true,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+
+	/* only the first message posted to an empty queue needs a wakeup */
+	if (head == NULL) {
+		motif_event_wake();
+	}
+}
+
+/* exported function documented in motif/schedule.h */
+nserror
+motif_schedule_from_thread(int tival, void (*callback)(void *p), void *p)
+{
+	struct motif_schedule_msg *msg;
+
+	msg = malloc(sizeof(struct motif_schedule_msg));
+	if (msg == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	msg->tival = tival;
+	msg->slack = schedule_class_slack[SCHEDULE_CLASS_LAYOUT];
+	msg->cls = SCHEDULE_CLASS_LAYOUT;
+	msg->callback = callback;
+	msg->p = p;
+	msg->allocated = true;
+
+	motif_schedule_post(msg);
+
+	return NSERROR_OK;
+}
+
+/**
+ * Move callbacks posted from other threads onto the schedule.
+ */
+static void schedule_drain_posted(void)
+{
+	struct motif_schedule_msg *msg;
+	struct motif_schedule_msg *fifo = NULL;
+
+	if (__atomic_load_n(&schedule_posted, __ATOMIC_RELAXED) == NULL) {
+		return;
+	}
+
+	msg = __atomic_exchange_n(&schedule_posted, NULL, __ATOMIC_ACQUIRE);
+
+	/* the stack is newest first, reverse it to keep posting order */
+	while (msg != NULL) {
+		struct motif_schedule_msg *next = msg->next;
+		msg->next = fifo;
+		fifo = msg;
+		msg = next;
+	}
+
+	while (fifo != NULL) {
+		struct motif_schedule_msg *next = fifo->next;
+
+		motif_schedule_slack(fifo->tival, fifo->slack, fifo->cls,
+				     fifo->callback, fifo->p);
+
+		/* the poster may reuse its message from here on */
+		if (fifo->allocated) {
+			free(fifo);
+		}
+		fifo = next;
+	}
+}
+
 /* exported function documented in framebuffer/schedule.h */
 int schedule_run(void)
 {
 	struct timeval tv;
-	struct timeval nexttime;
+	struct timeval now;
 	struct timeval rettime;
-	struct nscallback *cur_nscb;
-	struct nscallback *prev_nscb;
-	struct nscallback *unlnk_nscb;
-	int callbackCount = 0;
-	int callbackRunCount = 0;
-	int callbackSkipCount = 0;
-
-	if (schedule_list == NULL)
+	struct timeval budget;
+	struct timeval done;
+	struct nscallback *nscb;
+	struct schedule_stats *stats;
+	unsigned int depth;
+	struct nscallback **link;
+	void (*callback)(void *p);
+	void *p;
+	int budget_ms;
+	int cls;
+
+	schedule_deferred = false;
+
+	schedule_drain_posted();
+
+	if (schedule_count == 0)
 		return -1;
 
-	/* reset enumeration to the start of the list */
-        cur_nscb = schedule_list;
-        prev_nscb = NULL;
-	nexttime = cur_nscb->tv;
+	schedule_gettime(&tv);
 
-	gettimeofday(&tv, NULL);
+	/* callbacks outside the redraw class stop being dispatched
+	 * once this much real time has been spent in this tick
+	 */
+	budget_ms = nsoption_int(motif_schedule_budget);
+	if (budget_ms > 0) {
+		gettimeofday(&now, NULL);
+		budget.tv_sec = budget_ms / 1000;
+		budget.tv_usec = (budget_ms % 1000) * 1000;
+		timeradd(&now, &budget, &budget);
+	}
+
+	schedule_running = true;
+	for (cls = 0; cls < SCHEDULE_CLASS_COUNT; cls++) {
+		struct schedule_queue *q = &schedule_queues[cls];
 
-	while (cur_nscb != NULL) {
-		callbackCount++;
-		if (timercmp(&tv, &cur_nscb->tv, >)) {
-			callbackRunCount++;
-            /* scheduled time */
+		while ((nscb = schedule_due(q, &tv)) != NULL) {
+			unsigned long late;
 
-            /* remove callback */
-			unlnk_nscb = cur_nscb;
+			gettimeofday(&now, NULL);
+			if ((cls != SCHEDULE_CLASS_REDRAW) &&
+			    (budget_ms > 0) &&
+			    timercmp(&now, &budget, >)) {
+				schedule_deferred = true;
+				break;
+			}
 
-			if (prev_nscb == NULL) {
-				schedule_list = unlnk_nscb->next;
-			} else {
-				prev_nscb->next = unlnk_nscb->next;
+			schedule_gettime(&rettime);
+			timersub(&rettime, &nscb->tv, &rettime);
+			late = (rettime.tv_sec * 1000000) + rettime.tv_usec;
+			q->total_late += late;
+			if (late > q->max_late) {
+				q->max_late = late;
 			}
+			q->run++;
 
-			unlnk_nscb->callback(unlnk_nscb->p);
-
-			free(unlnk_nscb);
-
-            /* need to deal with callback modifying the list. */
-			if (schedule_list == NULL)
-				return -1; /* no more callbacks scheduled */
-			
-            /* reset enumeration to the start of the list */
-            cur_nscb = schedule_list;
-            prev_nscb = NULL;
-			nexttime = cur_nscb->tv;
-        } else {
-			callbackSkipCount++;
-			/* if the time to the event is sooner than the
-			 * currently recorded soonest event record it 
+			/* remove callback before running it as the callback
+			 * is free to reschedule itself or modify the queue.
 			 */
-			if (timercmp(&nexttime, &cur_nscb->tv, >)) {
-				nexttime = cur_nscb->tv;
+			callback = nscb->callback;
+			p = nscb->p;
+			depth = schedule_count;
+			schedule_find(callback, p, &link);
+			schedule_release(nscb, link);
+
+			motif_watchdog_enter("scheduled callback", NULL,
+					     (void *)callback);
+			callback(p);
+			motif_watchdog_leave();
+
+			stats = schedule_stats_get(callback);
+			if (stats == NULL) {
+				schedule_stats_dropped++;
+				continue;
 			}
-            /* move to next element */
-            prev_nscb = cur_nscb;
-            cur_nscb = prev_nscb->next;
-        }
-    }
+			gettimeofday(&done, NULL);
+			timersub(&done, &now, &done);
+			stats->count++;
+			schedule_histogram_add(&stats->late, late);
+			schedule_histogram_add(&stats->runtime,
+					       (done.tv_sec * 1000000) +
+					       done.tv_usec);
+			schedule_histogram_add(&stats->depth, depth);
+		}
+
+		if (schedule_deferred) {
+			/* count every class left with due callbacks */
+			for (; cls < SCHEDULE_CLASS_COUNT; cls++) {
+				q = &schedule_queues[cls];
+				if (schedule_due(q, &tv) != NULL) {
+					q->deferred++;
+				}
+			}
+			break;
+		}
+	}
+	schedule_running = false;
+
+	schedule_arm();
+
+	if (schedule_deferred) {
+		NSLOG(schedule, DEBUG, "budget exhausted, deferring callbacks");
+		return 0;
+	}
+
+	nscb = schedule_earliest();
+	if (nscb == NULL)
+		return -1; /* no more callbacks scheduled */
 
-	//printf("Stepped over %d callbacks running %d and skipping %d\n", callbackCount, callbackRunCount, callbackSkipCount);
 	/* make rettime relative to now */
-	timersub(&nexttime, &tv, &rettime);
+	timersub(&nscb->latest, &tv, &rettime);
 
 	NSLOG(schedule, DEBUG,
 	      "returning time to next event as %ldms",
 	      (rettime.tv_sec * 1000) + (rettime.tv_usec / 1000)); 
 
 	/* return next event time in milliseconds (24days max wait) */
-    return (rettime.tv_sec * 1000) + (rettime.tv_usec / 1000);
+	return (rettime.tv_sec * 1000) + (rettime.tv_usec / 1000);
+}
+
+/**
+ * Xt work procedure running one chunk of the next idle task.
+ *
+ * Xt only calls this when no X event, input or timer is ready, and
+ * goes back to dispatching those as soon as the chunk returns.
+ */
+static Boolean schedule_idle_work(XtPointer client_data)
+{
+	struct nsidle *idle = schedule_idle_list;
+	struct nsidle **link;
+	bool finished;
+
+	if (idle == NULL) {
+		schedule_idle_proc = 0;
+		return True;
+	}
+
+	/* detach while running as the task may add or remove tasks */
+	schedule_idle_list = idle->next;
+	idle->next = NULL;
+	schedule_idle_current = idle;
+	schedule_idle_removed = false;
+
+	finished = idle->task(idle->p);
+
+	schedule_idle_current = NULL;
+	if (finished || schedule_idle_removed) {
+		free(idle);
+	} else {
+		/* round robin with the other tasks */
+		link = &schedule_idle_list;
+		while (*link != NULL) {
+			link = &(*link)->next;
+		}
+		*link = idle;
+	}
+
+	if (schedule_idle_list == NULL) {
+		schedule_idle_proc = 0;
+		return True;
+	}
+	return False;
+}
+
+/**
+ * Ensure the work procedure is registered while idle tasks exist.
+ */
+static void schedule_idle_arm(void)
+{
+	if ((schedule_app != NULL) &&
+	    (schedule_idle_list != NULL) &&
+	    (schedule_idle_proc == 0)) {
+		schedule_idle_proc = XtAppAddWorkProc(schedule_app,
+						      schedule_idle_work,
+						      NULL);
+	}
+}
+
+/* exported function documented in motif/schedule.h */
+nserror motif_schedule_idle(bool (*task)(void *p), void *p)
+{
+	struct nsidle *idle;
+
+	if ((schedule_idle_current != NULL) &&
+	    (schedule_idle_current->task == task) &&
+	    (schedule_idle_current->p == p) &&
+	    !schedule_idle_removed) {
+		return NSERROR_OK;
+	}
+	for (idle = schedule_idle_list; idle != NULL; idle = idle->next) {
+		if ((idle->task == task) && (idle->p == p)) {
+			return NSERROR_OK;
+		}
+	}
+
+	idle = malloc(sizeof(struct nsidle));
+	if (idle == NULL) {
+		return NSERROR_NOMEM;
+	}
+	idle->task = task;
+	idle->p = p;
+	idle->next = schedule_idle_list;
+	schedule_idle_list = idle;
+
+	schedule_idle_arm();
+
+	return NSERROR_OK;
+}
+
+/* exported function documented in motif/schedule.h */
+void motif_schedule_idle_remove(bool (*task)(void *p), void *p)
+{
+	struct nsidle **link = &schedule_idle_list;
+
+	if ((schedule_idle_current != NULL) &&
+	    (schedule_idle_current->task == task) &&
+	    (schedule_idle_current->p == p)) {
+		schedule_idle_removed = true;
+		return;
+	}
+
+	while (*link != NULL) {
+		if (((*link)->task == task) && ((*link)->p == p)) {
+			struct nsidle *idle = *link;
+			*link = idle->next;
+			free(idle);
+			break;
+		}
+		link = &(*link)->next;
+	}
+
+	if ((schedule_idle_list == NULL) && (schedule_idle_proc != 0)) {
+		XtRemoveWorkProc(schedule_idle_proc);
+		schedule_idle_proc = 0;
+	}
+}
+
+/* exported function documented in motif/schedule.h */
+bool motif_schedule_idle_pending(void)
+{
+	return schedule_idle_list != NULL;
+}
+
+/* exported function documented in motif/schedule.h */
+bool motif_schedule_advance(void)
+{
+	struct nscallback *nscb;
+
+	if (!schedule_virtual) {
+		return false;
+	}
+
+	nscb = schedule_earliest();
+	if (nscb == NULL) {
+		return false;
+	}
+
+	/* callbacks run once the clock has passed their deadline, going
+	 * to the end of the window groups them as the timer would
+	 */
+	if (!timercmp(&schedule_virtual_tv, &nscb->latest, >)) {
+		schedule_virtual_tv = nscb->latest;
+		schedule_virtual_tv.tv_usec++;
+		if (schedule_virtual_tv.tv_usec >= 1000000) {
+			schedule_virtual_tv.tv_sec++;
+			schedule_virtual_tv.tv_usec -= 1000000;
+		}
+	}
+
+	schedule_run();
+
+	return true;
+}
+
+/* exported function documented in motif/schedule.h */
+void motif_schedule_init(XtAppContext app)
+{
+	schedule_app = app;
+
+	if (nsoption_bool(motif_virtual_clock)) {
+		NSLOG(netsurf, INFO, "Scheduler using virtual clock");
+		/* start from the time of day so callbacks already
+		 * scheduled keep their deadlines
+		 */
+		gettimeofday(&schedule_virtual_tv, NULL);
+		schedule_virtual = true;
+		if (schedule_timer != 0) {
+			XtRemoveTimeOut(schedule_timer);
+			schedule_timer = 0;
+		}
+	}
+
+	schedule_arm();
+	schedule_idle_arm();
+}
+
+/* exported function documented in motif/schedule.h */
+void motif_schedule_stats_dump(FILE *fp)
+{
+	unsigned int idx;
+	bool first = true;
+	int cls;
+
+	fprintf(fp, "{\n\"callbacks\": [");
+
+	for (idx = 0; (schedule_stats != NULL) && (idx < SCHEDULE_STATS_SIZE); idx++) {
+		struct schedule_stats *stats = &schedule_stats[idx];
+		Dl_info info;
+		const char *sym = NULL;
+
+		if (stats->callback == NULL) {
+			continue;
+		}
+
+		if ((dladdr((void *)stats->callback, &info) != 0) &&
+		    (info.dli_saddr == (void *)stats->callback)) {
+			sym = info.dli_sname;
+		}
+
+		fprintf(fp, "%s\n  {\"address\": \"%p\", \"symbol\": ",
+			first ? "" : ",", (void *)stats->callback);
+		if (sym != NULL) {
+			/* C identifiers need no escaping */
+			fprintf(fp, "\"%s\"", sym);
+		} else {
+			fprintf(fp, "null");
+		}
+		fprintf(fp, ", \"count\": %lu,\n   ", stats->count);
+		schedule_histogram_dump(fp, "lateness_us", &stats->late);
+		fprintf(fp, ",\n   ");
+		schedule_histogram_dump(fp, "runtime_us", &stats->runtime);
+		fprintf(fp, ",\n   ");
+		schedule_histogram_dump(fp, "queue_depth", &stats->depth);
+		fprintf(fp, "}");
+		first = false;
+	}
+
+	fprintf(fp, "\n],\n\"dropped\": %lu,\n\"classes\": [",
+		schedule_stats_dropped);
+
+	for (cls = 0; cls < SCHEDULE_CLASS_COUNT; cls++) {
+		struct schedule_queue *q = &schedule_queues[cls];
+		fprintf(fp, "%s\n  {\"name\": \"%s\", \"queued\": %u, "
+			"\"run\": %lu, \"deferred\": %lu, "
+			"\"max_late_us\": %lu, \"total_late_us\": %llu}",
+			(cls == 0) ? "" : ",", schedule_class_name[cls],
+			q->count, q->run, q->deferred,
+			q->max_late, q->total_late);
+	}
+
+	fprintf(fp, "\n]\n}\n");
+	fflush(fp);
+}
+
+/* exported function documented in motif/schedule.h */
+nserror motif_schedule_stats_write(void)
+{
+	const char *path = nsoption_charp(motif_schedule_stats_file);
+	FILE *fp;
+
+	if ((path == NULL) || (*path == 0)) {
+		motif_schedule_stats_dump(stderr);
+		return NSERROR_OK;
+	}
+
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		NSLOG(netsurf, INFO, "Unable to open %s for scheduler statistics",
+		      path);
+		return NSERROR_SAVE_FAILED;
+	}
+	motif_schedule_stats_dump(fp);
+	fclose(fp);
+
+	return NSERROR_OK;
 }
 
 void list_schedule(void)
 {
 	struct timeval tv;
-        struct nscallback *cur_nscb;
+	unsigned int idx;
+	int cls;
 
-	gettimeofday(&tv, NULL);
+	schedule_gettime(&tv);
+
+	NSLOG(netsurf, INFO, "schedule list at %ld:%ld", tv.tv_sec,
+	      tv.tv_usec);
 
-        NSLOG(netsurf, INFO, "schedule list at %ld:%ld", tv.tv_sec,
-              tv.tv_usec);
+	for (cls = 0; cls < SCHEDULE_CLASS_COUNT; cls++) {
+		struct schedule_queue *q = &schedule_queues[cls];
 
-        cur_nscb = schedule_list;
+		NSLOG(netsurf, INFO,
+		      "class %s: %u queued, %lu run, %lu deferred, lateness max %luus mean %luus",
+		      schedule_class_name[cls], q->count, q->run, q->deferred,
+		      q->max_late,
+		      (q->run > 0) ? (unsigned long)(q->total_late / q->run) : 0);
 
-        while (cur_nscb != NULL) {
-                NSLOG(netsurf, INFO, "Schedule %p at %ld:%ld", cur_nscb,
-                      cur_nscb->tv.tv_sec, cur_nscb->tv.tv_usec);
-                cur_nscb = cur_nscb->next;
-        }
+		for (idx = 0; idx < q->count; idx++) {
+			NSLOG(netsurf, INFO, "Schedule %p at %ld:%ld",
+			      q->heap[SCHEDULE_BY_LATEST][idx],
+			      q->heap[SCHEDULE_BY_LATEST][idx]->tv.tv_sec,
+			      q->heap[SCHEDULE_BY_LATEST][idx]->tv.tv_usec);
+		}
+	}
 }
 
 
@@ -19,6 +19,21 @@
 #ifndef FRAMEBUFFER_SCHEDULE_H
 #define FRAMEBUFFER_SCHEDULE_H
 
+#include <stdbool.h>
+#include <stdio.h>
+#include <X11/Intrinsic.h>
+
+/**
+ * Scheduled callback priority classes, dispatched in this order.
+ */
+enum motif_schedule_class {
+	SCHEDULE_CLASS_REDRAW, /**< screen updates, never deferred */
+	SCHEDULE_CLASS_LAYOUT, /**< reformatting and core callbacks */
+	SCHEDULE_CLASS_NETWORK, /**< fetch polling and timeouts */
+	SCHEDULE_CLASS_BACKGROUND, /**< cleanup and other deferrable work */
+	SCHEDULE_CLASS_COUNT
+};
+
 /**
  * Schedule a callback.
  *
@@ -32,14 +47,165 @@
 
 nserror motif_schedule(int tival, void (*callback)(void *p), void *p);
 
+/**
+ * Schedule a callback in a priority class.
+ *
+ * \param  tival     interval before the callback should be made in ms
+ * \param  cls       priority class of the callback
+ * \param  callback  callback function
+ * \param  p         user parameter, passed to callback function
+ *
+ * As motif_schedule() which places callbacks in the layout class.
+ * Rescheduling an existing callback moves it to the given class. The
+ * default slack of the class is used.
+ */
+nserror motif_schedule_class(int tival, enum motif_schedule_class cls, void (*callback)(void *p), void *p);
+
+/**
+ * Schedule a callback with a slack tolerance.
+ *
+ * \param  tival     interval before the callback should be made in ms
+ * \param  slack     further ms the callback may be delayed by
+ * \param  cls       priority class of the callback
+ * \param  callback  callback function
+ * \param  p         user parameter, passed to callback function
+ *
+ * The callback is made between tival and tival + slack ms from now.
+ * The scheduler wakes at the end of the earliest window and runs every
+ * callback whose window has opened, so callbacks with overlapping
+ * windows share a single wakeup.
+ */
+nserror motif_schedule_slack(int tival, int slack, enum motif_schedule_class cls, void (*callback)(void *p), void *p);
+
+/**
+ * Callback posted to the scheduler from another thread.
+ *
+ * Posters may embed this in their own structures and pass it to
+ * motif_schedule_post(). It is read on the Xt thread and must stay
+ * valid until the callback has been made.
+ */
+struct motif_schedule_msg {
+	struct motif_schedule_msg *next; /**< queue link, owned by the queue */
+	int tival; /**< interval in ms, applied when the Xt thread drains */
+	int slack; /**< further ms the callback may be delayed by */
+	enum motif_schedule_class cls; /**< priority class of the callback */
+	void (*callback)(void *p); /**< callback function */
+	void *p; /**< user parameter, passed to callback function */
+	bool allocated; /**< freed by the scheduler once drained */
+};
+
+/**
+ * Post a callback to the scheduler from any thread.
+ *
+ * The message is pushed on a lock free queue and the Xt thread is
+ * woken to drain it in schedule_run(), where it is scheduled as by
+ * motif_schedule_slack() in its class. Messages from one thread are
+ * scheduled in the order they were posted.
+ *
+ * \param msg The message to post, next is ignored and allocated
+ *            must be false.
+ */
+void motif_schedule_post(struct motif_schedule_msg *msg);
+
+/**
+ * Schedule a callback from any thread.
+ *
+ * As motif_schedule() but safe to call from threads other than the
+ * Xt thread. The message is allocated here and freed once drained.
+ *
+ * \param  tival     interval before the callback should be made in ms
+ * \param  callback  callback function
+ * \param  p         user parameter, passed to callback function
+ * \return NSERROR_OK on success or NSERROR_NOMEM.
+ */
+nserror motif_schedule_from_thread(int tival, void (*callback)(void *p), void *p);
+
 /**
  * Process scheduled callbacks up to current time.
  *
- * @return The number of milliseconds untill the next scheduled event
- * or -1 for no event.
+ * Classes are run in priority order. Once the motif_schedule_budget
+ * option has been used up, callbacks outside the redraw class are
+ * left for a later call.
+ *
+ * @return The number of milliseconds untill the next scheduled event,
+ * 0 when due callbacks were deferred or -1 for no event.
  */
 int schedule_run(void);
 
+/**
+ * Add an idle task.
+ *
+ * The task is called whenever the X queue is empty and no scheduled
+ * callback is due, and should do a small amount of work each time so
+ * the next input event is not held up. Several idle tasks take turns.
+ * Adding a task which is already present does nothing.
+ *
+ * \param task Task function, returning true once the work is finished.
+ * \param p user parameter, passed to the task function.
+ * \return NSERROR_OK on success or NSERROR_NOMEM.
+ */
+nserror motif_schedule_idle(bool (*task)(void *p), void *p);
+
+/**
+ * Remove an idle task.
+ *
+ * \param task Task function.
+ * \param p user parameter the task was added with.
+ */
+void motif_schedule_idle_remove(bool (*task)(void *p), void *p);
+
+/**
+ * Check if there are idle tasks waiting to run.
+ *
+ * \return true if any idle task is present.
+ */
+bool motif_schedule_idle_pending(void);
+
+/**
+ * Advance the virtual clock to the next deadline and run due callbacks.
+ *
+ * The event loop calls this when it has no input to wait for. The
+ * virtual clock never moves on its own, so runs are repeatable and
+ * idle periods between callbacks take no wall time.
+ *
+ * \return true if the virtual clock is in use and callbacks are
+ * scheduled, false if the caller should wait for events.
+ */
+bool motif_schedule_advance(void);
+
+/**
+ * Drive scheduled callbacks from an Xt application context.
+ *
+ * A single Xt timer is kept armed for the earliest deadline, so the
+ * main loop only wakes when a callback is due. When the
+ * motif_virtual_clock option is set no timer is armed and the event
+ * loop advances the clock instead.
+ *
+ * \param app The application context to add the timer to.
+ */
+void motif_schedule_init(XtAppContext app);
+
+/**
+ * Write scheduler statistics as JSON.
+ *
+ * For every callback function run so far the invocation count and log2
+ * histograms of lateness, runtime and queue depth at dispatch are
+ * written, with the function resolved to a symbol where possible,
+ * followed by the per class counters.
+ *
+ * \param fp The stream to write to.
+ */
+void motif_schedule_stats_dump(FILE *fp);
+
+/**
+ * Write scheduler statistics to the configured file.
+ *
+ * Uses the motif_schedule_stats_file option, or stderr when unset.
+ *
+ * \return NSERROR_OK on success or error code on faliure.
+ */
+nserror motif_schedule_stats_write(void);
+
 void list_schedule(void);
 
 #endif
@@ -0,0 +1,503 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Pixel conversion kernels.
+ *
+ * Bitmaps are converted for the server one mask byte, eight pixels, at
+ * a time, reordering the bytes, packing the alpha mask and collecting
+ * the opacity in the same pass. x86 builds use SSE2, or AVX2 when the
+ * processor has it, other processors use the portable loops.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "utils/log.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define SWIZZLE_X86 1
+#include <immintrin.h>
+#endif
+
+#include "motif/swizzle.h"
+
+/* the benchmark image, one 4K frame */
+#define SWIZZLE_BENCH_WIDTH 3840
+#define SWIZZLE_BENCH_HEIGHT 2160
+
+/* benchmark runs, the fastest is reported */
+#define SWIZZLE_BENCH_RUNS 8
+
+/**
+ * Convert one row of pixels, storing a mask byte per eight pixels.
+ */
+typedef unsigned int (*swizzle_row_fn)(const uint32_t *src, uint32_t *dst, int width,
+				       enum motif_swizzle_order order, uint8_t *mask);
+
+/* row kernel picked for this processor, NULL until first used */
+static swizzle_row_fn swizzle_row = NULL;
+
+static inline uint32_t swizzle_pixel(uint32_t v, enum motif_swizzle_order order)
+{
+	if(order == MOTIF_SWIZZLE_REVERSE) {
+		return (v >> 24) | ((v >> 8) & 0x0000ff00) | ((v & 0x0000ff00) << 8) | (v << 24);
+	}
+	return (v >> 8) | (v << 24);
+}
+
+/**
+ * Turn the collected alpha and mask state into MOTIF_SWIZZLE_ flags.
+ */
+static inline unsigned int swizzle_flags(uint32_t alpha, bool masked)
+{
+	return (masked ? MOTIF_SWIZZLE_MASKED : 0) |
+		(((alpha & 0xff) != 0xff) ? MOTIF_SWIZZLE_ALPHA : 0);
+}
+
+static unsigned int swizzle_row_scalar(const uint32_t *src, uint32_t *dst, int width,
+				       enum motif_swizzle_order order, uint8_t *mask)
+{
+	uint32_t keep = (mask != NULL) ? 0xffffffff : 0x00ffffff;
+	uint32_t alpha = 0xff;
+	bool masked = false;
+	int x = 0;
+
+	while(x < width) {
+		int count = ((width - x) < 8) ? (width - x) : 8;
+		unsigned int byte = 0;
+
+		for(int k = 0; k < count; k++) {
+			uint32_t v = src[x + k];
+			alpha &= v;
+			byte |= ((v >> 7) & 1) << k;
+			dst[x + k] = swizzle_pixel(v, order) & keep;
+		}
+		if(mask != NULL) {
+			*mask++ = byte;
+		}
+		masked |= (byte != ((1u << count) - 1));
+		x += count;
+	}
+
+	return (mask != NULL) ? swizzle_flags(alpha, masked) : 0;
+}
+
+#ifdef SWIZZLE_X86
+static inline __m128i swizzle_sse2(__m128i v, enum motif_swizzle_order order)
+{
+	if(order == MOTIF_SWIZZLE_REVERSE) {
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	}
+	return _mm_or_si128(_mm_srli_epi32(v, 8), _mm_slli_epi32(v, 24));
+}
+
+/**
+ * Mask bits of four pixels with alpha in the low byte.
+ */
+static inline int swizzle_bits_sse2(__m128i v)
+{
+	return _mm_movemask_ps(_mm_castsi128_ps(_mm_slli_epi32(v, 24)));
+}
+
+static unsigned int swizzle_row_sse2(const uint32_t *src, uint32_t *dst, int width,
+				     enum motif_swizzle_order order, uint8_t *mask)
+{
+	const __m128i keep = _mm_set1_epi32((mask != NULL) ? -1 : 0x00ffffff);
+	__m128i alphas = _mm_set1_epi32(-1);
+	uint32_t lanes[4];
+	unsigned int flags = 0;
+	bool masked = false;
+	int x;
+
+	for(x = 0; (x + 8) <= width; x += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + x + 4));
+		int byte = swizzle_bits_sse2(a) | (swizzle_bits_sse2(b) << 4);
+
+		alphas = _mm_and_si128(alphas, _mm_and_si128(a, b));
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_and_si128(swizzle_sse2(a, order), keep));
+		_mm_storeu_si128((__m128i *)(dst + x + 4), _mm_and_si128(swizzle_sse2(b, order), keep));
+		if(mask != NULL) {
+			mask[x >> 3] = byte;
+		}
+		masked |= (byte != 0xff);
+	}
+
+	if(x < width) {
+		flags = swizzle_row_scalar(src + x, dst + x, width - x, order,
+					   (mask != NULL) ? (mask + (x >> 3)) : NULL);
+	}
+	if(mask == NULL) {
+		return 0;
+	}
+
+	_mm_storeu_si128((__m128i *)lanes, alphas);
+	return flags | swizzle_flags(lanes[0] & lanes[1] & lanes[2] & lanes[3], masked);
+}
+
+__attribute__((target("avx2")))
+static unsigned int swizzle_row_avx2(const uint32_t *src, uint32_t *dst, int width,
+				     enum motif_swizzle_order order, uint8_t *mask)
+{
+	const __m256i reverse = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+						 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	const __m256i keep = _mm256_set1_epi32((mask != NULL) ? -1 : 0x00ffffff);
+	__m256i alphas = _mm256_set1_epi32(-1);
+	uint32_t lanes[8];
+	unsigned int flags = 0;
+	bool masked = false;
+	int x;
+
+	for(x = 0; (x + 8) <= width; x += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + x));
+		int byte = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(v, 24)));
+		__m256i s;
+
+		alphas = _mm256_and_si256(alphas, v);
+		if(order == MOTIF_SWIZZLE_REVERSE) {
+			s = _mm256_shuffle_epi8(v, reverse);
+		} else {
+			s = _mm256_or_si256(_mm256_srli_epi32(v, 8), _mm256_slli_epi32(v, 24));
+		}
+		_mm256_storeu_si256((__m256i *)(dst + x), _mm256_and_si256(s, keep));
+		if(mask != NULL) {
+			mask[x >> 3] = byte;
+		}
+		masked |= (byte != 0xff);
+	}
+
+	if(x < width) {
+		flags = swizzle_row_scalar(src + x, dst + x, width - x, order,
+					   (mask != NULL) ? (mask + (x >> 3)) : NULL);
+	}
+	if(mask == NULL) {
+		return 0;
+	}
+
+	_mm256_storeu_si256((__m256i *)lanes, alphas);
+	return flags | swizzle_flags(lanes[0] & lanes[1] & lanes[2] & lanes[3] &
+				     lanes[4] & lanes[5] & lanes[6] & lanes[7], masked);
+}
+#endif
+
+/**
+ * Pick the fastest row kernel the processor supports.
+ */
+static swizzle_row_fn swizzle_select(void)
+{
+	swizzle_row_fn fn = __atomic_load_n(&swizzle_row, __ATOMIC_RELAXED);
+
+	if(fn == NULL) {
+#ifdef SWIZZLE_X86
+		__builtin_cpu_init();
+		fn = __builtin_cpu_supports("avx2") ? swizzle_row_avx2 : swizzle_row_sse2;
+#else
+		fn = swizzle_row_scalar;
+#endif
+		__atomic_store_n(&swizzle_row, fn, __ATOMIC_RELAXED);
+	}
+
+	return fn;
+}
+
+/**
+ * Convert an image a row at a time with the given kernel.
+ */
+static unsigned int swizzle_rows(swizzle_row_fn fn, const uint32_t *src, uint32_t *dst, int width, int height,
+				 enum motif_swizzle_order order, uint8_t *mask)
+{
+	int maskStride = (width + 7) >> 3;
+	unsigned int flags = 0;
+
+	for(int y = 0; y < height; y++) {
+		flags |= fn(src, dst, width, order, mask);
+		src += width;
+		dst += width;
+		if(mask != NULL) {
+			mask += maskStride;
+		}
+	}
+
+	return flags;
+}
+
+/* exported function documented in motif/swizzle.h */
+unsigned int motif_swizzle(const uint32_t *src, uint32_t *dst, int width, int height,
+			   enum motif_swizzle_order order, uint8_t *mask)
+{
+	return swizzle_rows(swizzle_select(), src, dst, width, height, order, mask);
+}
+
+/* exported function documented in motif/swizzle.h */
+unsigned int motif_swizzle_opacity(const uint32_t *src, size_t count)
+{
+	uint32_t alpha = 0xff;
+	size_t i = 0;
+
+#ifdef SWIZZLE_X86
+	__m128i alphas = _mm_set1_epi32(-1);
+	uint32_t lanes[4];
+
+	for(; (i + 8) <= count; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i + 4));
+
+		// a pixel below half opacity settles both flags
+		if((swizzle_bits_sse2(a) & swizzle_bits_sse2(b)) != 0xf) {
+			return MOTIF_SWIZZLE_MASKED | MOTIF_SWIZZLE_ALPHA;
+		}
+		alphas = _mm_and_si128(alphas, _mm_and_si128(a, b));
+	}
+	_mm_storeu_si128((__m128i *)lanes, alphas);
+	alpha = lanes[0] & lanes[1] & lanes[2] & lanes[3];
+#endif
+
+	for(; i < count; i++) {
+		if(!(src[i] & 0x80)) {
+			return MOTIF_SWIZZLE_MASKED | MOTIF_SWIZZLE_ALPHA;
+		}
+		alpha &= src[i];
+	}
+
+	return swizzle_flags(alpha, false);
+}
+
+/* exported function documented in motif/swizzle.h */
+unsigned int motif_swizzle_mask(const uint32_t *src, int width, int height, uint8_t *mask)
+{
+	bool masked = false;
+
+	for(int y = 0; y < height; y++) {
+		int x = 0;
+
+#ifdef SWIZZLE_X86
+		for(; (x + 8) <= width; x += 8) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+			__m128i b = _mm_loadu_si128((const __m128i *)(src + x + 4));
+			int byte = _mm_movemask_ps(_mm_castsi128_ps(a)) |
+				(_mm_movemask_ps(_mm_castsi128_ps(b)) << 4);
+
+			*mask++ = byte;
+			masked |= (byte != 0xff);
+		}
+#endif
+		while(x < width) {
+			int count = ((width - x) < 8) ? (width - x) : 8;
+			unsigned int byte = 0;
+
+			for(int k = 0; k < count; k++) {
+				byte |= (src[x + k] >> 31) << k;
+			}
+			*mask++ = byte;
+			masked |= (byte != ((1u << count) - 1));
+			x += count;
+		}
+		src += width;
+	}
+
+	return masked ? MOTIF_SWIZZLE_MASKED : 0;
+}
+
+/**
+ * Buffers shared by the benchmark runs.
+ */
+struct swizzle_bench {
+	const uint32_t *src;
+	uint32_t *dst;
+	uint8_t *mask;
+	unsigned int flags;
+};
+
+/**
+ * The conversion as it was written before the kernels, a pixel at a time.
+ */
+static void swizzle_bench_legacy(struct swizzle_bench *bench)
+{
+	const uint32_t *pixels = bench->src;
+	uint8_t *maskBuffer = bench->mask;
+	int maskBit = 0;
+	int maskValue = 0;
+	int maskOffset = 0;
+	int hasMask = 0;
+	int i = 0;
+
+	for(int y = 0; y < SWIZZLE_BENCH_HEIGHT; y++) {
+		for(int x = 0; x < SWIZZLE_BENCH_WIDTH; x++) {
+			uint32_t a = pixels[i] & 0x000000ff;
+			if(a & 0x00000080) {
+				maskValue = (maskValue>>1)|0x80;
+			} else {
+				hasMask = 1;
+				maskValue = (maskValue>>1);
+			}
+			maskBit++;
+			if(maskBit == 8) {
+				maskBuffer[maskOffset++] = maskValue;
+				maskValue = 0;
+				maskBit = 0;
+			}
+			bench->dst[i] = ((pixels[i]>>24)&0x000000ff)|((pixels[i]>>8)&0x0000ff00)|((pixels[i]&0x0000ff00)<<8)|(a<<24);
+			i++;
+		}
+		if(maskBit > 0) {
+			maskValue >>= (8-maskBit);
+			maskBuffer[maskOffset++] = maskValue;
+			maskValue = 0;
+			maskBit = 0;
+		}
+	}
+
+	bench->flags = hasMask;
+}
+
+static void swizzle_bench_scalar(struct swizzle_bench *bench)
+{
+	bench->flags = swizzle_rows(swizzle_row_scalar, bench->src, bench->dst,
+				    SWIZZLE_BENCH_WIDTH, SWIZZLE_BENCH_HEIGHT,
+				    MOTIF_SWIZZLE_REVERSE, bench->mask);
+}
+
+static void swizzle_bench_kernel(struct swizzle_bench *bench)
+{
+	bench->flags = motif_swizzle(bench->src, bench->dst,
+				     SWIZZLE_BENCH_WIDTH, SWIZZLE_BENCH_HEIGHT,
+				     MOTIF_SWIZZLE_REVERSE, bench->mask);
+}
+
+/**
+ * The opacity test as it was written before the kernels.
+ */
+static void swizzle_bench_legacy_opacity(struct swizzle_bench *bench)
+{
+	size_t count = SWIZZLE_BENCH_WIDTH * SWIZZLE_BENCH_HEIGHT;
+
+	bench->flags = 0;
+	for(size_t i = 0; i < count; i++) {
+		if(!(bench->src[i] & 0x00000080)) {
+			bench->flags = MOTIF_SWIZZLE_MASKED;
+			break;
+		}
+	}
+}
+
+static void swizzle_bench_opacity(struct swizzle_bench *bench)
+{
+	bench->flags = motif_swizzle_opacity(bench->src, SWIZZLE_BENCH_WIDTH * SWIZZLE_BENCH_HEIGHT);
+}
+
+/**
+ * Time the fastest of several runs in microseconds.
+ */
+static unsigned int swizzle_bench_time(void (*fn)(struct swizzle_bench *), struct swizzle_bench *bench)
+{
+	unsigned int best = 0;
+
+	for(int run = 0; run < SWIZZLE_BENCH_RUNS; run++) {
+		struct timeval start;
+		struct timeval end;
+		unsigned int us;
+
+		gettimeofday(&start, NULL);
+		fn(bench);
+		gettimeofday(&end, NULL);
+		timersub(&end, &start, &end);
+
+		us = (end.tv_sec * 1000000) + end.tv_usec;
+		if((run == 0) || (us < best)) {
+			best = us;
+		}
+	}
+
+	return best;
+}
+
+/* exported function documented in motif/swizzle.h */
+void motif_swizzle_benchmark(void)
+{
+	size_t count = SWIZZLE_BENCH_WIDTH * SWIZZLE_BENCH_HEIGHT;
+	size_t maskSize = ((SWIZZLE_BENCH_WIDTH + 7) >> 3) * SWIZZLE_BENCH_HEIGHT;
+	struct swizzle_bench bench;
+	uint32_t *src = malloc(count * 4);
+	uint32_t *dst = malloc(count * 4);
+	uint32_t *expected = malloc(count * 4);
+	uint8_t *mask = malloc(maskSize);
+	uint8_t *expectedMask = malloc(maskSize);
+	uint32_t seed = 1;
+
+	if((src == NULL) || (dst == NULL) || (expected == NULL) ||
+	   (mask == NULL) || (expectedMask == NULL)) {
+		NSLOG(netsurf, INFO, "No memory for the swizzle benchmark");
+		goto out;
+	}
+
+	// Mostly opaque with some translucent and clear pixels, like a photo
+	// with a soft edged cut out
+	for(size_t i = 0; i < count; i++) {
+		seed = (seed * 1103515245) + 12345;
+		src[i] = (seed & 0xffffff00) | (((seed >> 8) & 7) ? 0xff : (seed & 0xff));
+	}
+	bench.src = src;
+
+	NSLOG(netsurf, INFO, "Swizzle benchmark on %dx%d, best of %d runs",
+	      SWIZZLE_BENCH_WIDTH, SWIZZLE_BENCH_HEIGHT, SWIZZLE_BENCH_RUNS);
+
+	bench.dst = expected;
+	bench.mask = expectedMask;
+	NSLOG(netsurf, INFO, "  per pixel convert: %uus",
+	      swizzle_bench_time(swizzle_bench_legacy, &bench));
+
+	bench.dst = dst;
+	bench.mask = mask;
+	NSLOG(netsurf, INFO, "  scalar kernel convert: %uus",
+	      swizzle_bench_time(swizzle_bench_scalar, &bench));
+	NSLOG(netsurf, INFO, "  selected kernel convert: %uus",
+	      swizzle_bench_time(swizzle_bench_kernel, &bench));
+	if((memcmp(dst, expected, count * 4) != 0) ||
+	   (memcmp(mask, expectedMask, maskSize) != 0)) {
+		NSLOG(netsurf, WARNING, "  kernel output differs from the per pixel loop");
+	}
+
+	// Both opacity tests then have to look at every pixel
+	for(size_t i = 0; i < count; i++) {
+		src[i] |= 0xff;
+	}
+	NSLOG(netsurf, INFO, "  per pixel opacity: %uus",
+	      swizzle_bench_time(swizzle_bench_legacy_opacity, &bench));
+	NSLOG(netsurf, INFO, "  kernel opacity: %uus",
+	      swizzle_bench_time(swizzle_bench_opacity, &bench));
+
+out:
+	free(src);
+	free(dst);
+	free(expected);
+	free(mask);
+	free(expectedMask);
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset:8
+ * End:
+ */
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NETSURF_MOTIF_SWIZZLE_H
+#define NETSURF_MOTIF_SWIZZLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** some pixels are less than half opaque and masked out */
+#define MOTIF_SWIZZLE_MASKED 1
+
+/** some pixels are not fully opaque */
+#define MOTIF_SWIZZLE_ALPHA 2
+
+/**
+ * Byte orders RGBA pixels can be converted to.
+ */
+enum motif_swizzle_order {
+	MOTIF_SWIZZLE_REVERSE, /**< reverse the bytes of each pixel */
+	MOTIF_SWIZZLE_ROTATE, /**< move the alpha byte from the bottom to the top */
+};
+
+/**
+ * Convert RGBA pixels into server order and pack their mask.
+ *
+ * The alpha of each pixel is its low byte. It ends up in the top byte
+ * of the converted pixel, or is cleared when no mask is wanted. Mask
+ * rows are padded to whole bytes with the first pixel in the lowest
+ * bit, a bit is set where the pixel is at least half opaque.
+ *
+ * \param src The pixels to convert.
+ * \param dst Where to store converted pixels, may be src.
+ * \param width Width of the image.
+ * \param height Height of the image.
+ * \param order Byte order to convert to.
+ * \param mask Buffer for the mask or NULL for an opaque image.
+ * \return MOTIF_SWIZZLE_ flags of the pixels, 0 for an opaque image.
+ */
+unsigned int motif_swizzle(const uint32_t *src, uint32_t *dst, int width, int height, enum motif_swizzle_order order, uint8_t *mask);
+
+/**
+ * Find the opacity of RGBA pixels.
+ *
+ * \param src The pixels to test, alpha is the low byte.
+ * \param count Number of pixels.
+ * \return MOTIF_SWIZZLE_ flags of the pixels.
+ */
+unsigned int motif_swizzle_opacity(const uint32_t *src, size_t count);
+
+/**
+ * Pack the mask of converted pixels.
+ *
+ * Like motif_swizzle() but for pixels already in server order with
+ * alpha in the top byte.
+ *
+ * \param src The converted pixels.
+ * \param width Width of the image.
+ * \param height Height of the image.
+ * \param mask Buffer for the mask.
+ * \return MOTIF_SWIZZLE_MASKED if any pixel is masked out, otherwise 0.
+ */
+unsigned int motif_swizzle_mask(const uint32_t *src, int width, int height, uint8_t *mask);
+
+/**
+ * Time the kernels against per pixel loops on a 4K image.
+ *
+ * Run at startup when the motif_swizzle_benchmark option is set, the
+ * results are logged.
+ */
+void motif_swizzle_benchmark(void);
+
+#endif
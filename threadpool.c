@@ -0,0 +1,449 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Worker thread pool.
+ *
+ * Every worker owns a deque of jobs. Jobs are handed out to the deques
+ * in turn, a worker takes the newest job from its own deque and once
+ * that is empty steals the oldest job from another worker. Completion
+ * is posted back to the Xt thread through the scheduler.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "utils/log.h"
+#include "utils/errors.h"
+#include "utils/nsoption.h"
+
+#include <X11/Intrinsic.h>
+
+#include "motif/schedule.h"
+#include "motif/threadpool.h"
+
+/* upper limit on the number of workers */
+#define POOL_MAX_WORKERS 64
+
+struct motif_token {
+	int refcount; /**< references, updated atomically */
+	int cancelled; /**< set once cancelled, updated atomically */
+	unsigned int pending; /**< jobs queued or running, under pool_lock */
+};
+
+struct motif_job {
+	struct motif_job *prev; /**< older job in the deque */
+	struct motif_job *next; /**< newer job in the deque */
+	struct motif_token *token;
+	void (*run)(void *pw);
+	void (*done)(void *pw, bool cancelled);
+	void *pw;
+	bool cancelled; /**< run was skipped */
+	struct motif_schedule_msg msg; /**< completion message */
+};
+
+struct pool_worker {
+	pthread_t thread;
+	pthread_mutex_t lock; /**< protects the deque */
+	struct motif_job *head; /**< oldest job, stolen by other workers */
+	struct motif_job *tail; /**< newest job, taken by the owner */
+	unsigned int index;
+};
+
+static struct pool_worker *pool_workers = NULL;
+static unsigned int pool_worker_count = 0;
+
+/* next deque to receive a submitted job */
+static unsigned int pool_next = 0;
+
+/* jobs sitting in deques, updated atomically, may dip below zero */
+static int pool_queued = 0;
+
+static bool pool_quit = false;
+
+/* protects pool_quit and token pending counts */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* signalled when a job is queued or the pool stops */
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+
+/* signalled when a job finishes */
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+
+
+/* exported function documented in motif/threadpool.h */
+struct motif_token *motif_token_create(void)
+{
+	struct motif_token *token;
+
+	token = calloc(1, sizeof(struct motif_token));
+	if (token != NULL) {
+		token->refcount = 1;
+	}
+	return token;
+}
+
+/* exported function documented in motif/threadpool.h */
+struct motif_token *motif_token_ref(struct motif_token *token)
+{
+	__atomic_add_fetch(&token->refcount, 1, __ATOMIC_RELAXED);
+	return token;
+}
+
+/* exported function documented in motif/threadpool.h */
+void motif_token_unref(struct motif_token *token)
+{
+	if (__atomic_sub_fetch(&token->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+		free(token);
+	}
+}
+
+/* exported function documented in motif/threadpool.h */
+void motif_token_cancel(struct motif_token *token)
+{
+	__atomic_store_n(&token->cancelled, 1, __ATOMIC_RELEASE);
+}
+
+/* exported function documented in motif/threadpool.h */
+bool motif_token_cancelled(struct motif_token *token)
+{
+	return __atomic_load_n(&token->cancelled, __ATOMIC_ACQUIRE) != 0;
+}
+
+/**
+ * Remove a job from a worker deque, called with the worker locked.
+ */
+static void pool_unlink(struct pool_worker *worker, struct motif_job *job)
+{
+	if (job->prev != NULL) {
+		job->prev->next = job->next;
+	} else {
+		worker->head = job->next;
+	}
+	if (job->next != NULL) {
+		job->next->prev = job->prev;
+	} else {
+		worker->tail = job->prev;
+	}
+	job->prev = job->next = NULL;
+
+	__atomic_sub_fetch(&pool_queued, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Take a job for a worker, from its own deque or stolen from another.
+ */
+static struct motif_job *pool_take(struct pool_worker *self)
+{
+	struct motif_job *job;
+	unsigned int count;
+	unsigned int idx;
+
+	pthread_mutex_lock(&self->lock);
+	job = self->tail;
+	if (job != NULL) {
+		pool_unlink(self, job);
+	}
+	pthread_mutex_unlock(&self->lock);
+
+	/* workers may still be starting */
+	count = __atomic_load_n(&pool_worker_count, __ATOMIC_ACQUIRE);
+
+	for (idx = 1; (job == NULL) && (idx < count); idx++) {
+		struct pool_worker *victim;
+
+		victim = &pool_workers[(self->index + idx) % count];
+		pthread_mutex_lock(&victim->lock);
+		job = victim->head;
+		if (job != NULL) {
+			pool_unlink(victim, job);
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+
+	return job;
+}
+
+/**
+ * Take a queued job holding a token from any deque.
+ */
+static struct motif_job *pool_take_token(struct motif_token *token)
+{
+	struct motif_job *job = NULL;
+	unsigned int idx;
+
+	for (idx = 0; (job == NULL) && (idx < pool_worker_count); idx++) {
+		struct pool_worker *worker = &pool_workers[idx];
+
+		pthread_mutex_lock(&worker->lock);
+		for (job = worker->head; job != NULL; job = job->next) {
+			if (job->token == token) {
+				pool_unlink(worker, job);
+				break;
+			}
+		}
+		pthread_mutex_unlock(&worker->lock);
+	}
+
+	return job;
+}
+
+/**
+ * Complete a job on the Xt thread.
+ */
+static void pool_job_done(void *p)
+{
+	struct motif_job *job = p;
+
+	job->done(job->pw, job->cancelled);
+	motif_token_unref(job->token);
+	free(job);
+}
+
+/**
+ * Run a job unless its token is cancelled and post its completion.
+ */
+static void pool_execute(struct motif_job *job)
+{
+	if (motif_token_cancelled(job->token)) {
+		job->cancelled = true;
+	} else {
+		job->run(job->pw);
+	}
+
+	pthread_mutex_lock(&pool_lock);
+	job->token->pending--;
+	pthread_cond_broadcast(&pool_done);
+	pthread_mutex_unlock(&pool_lock);
+
+	/* completions usually end in a redraw, run them on the next pass */
+	job->msg.tival = 0;
+	job->msg.slack = 0;
+	job->msg.cls = SCHEDULE_CLASS_REDRAW;
+	job->msg.callback = pool_job_done;
+	job->msg.p = job;
+	job->msg.allocated = false;
+	motif_schedule_post(&job->msg);
+}
+
+static void *pool_worker_main(void *arg)
+{
+	struct pool_worker *self = arg;
+	struct motif_job *job;
+
+	for (;;) {
+		job = pool_take(self);
+		if (job != NULL) {
+			pool_execute(job);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool_lock);
+		while ((__atomic_load_n(&pool_queued, __ATOMIC_RELAXED) <= 0) &&
+		       !pool_quit) {
+			pthread_cond_wait(&pool_work, &pool_lock);
+		}
+		if (pool_quit &&
+		    (__atomic_load_n(&pool_queued, __ATOMIC_RELAXED) <= 0)) {
+			pthread_mutex_unlock(&pool_lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool_lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * Find the number of online processors.
+ */
+static int pool_cpu_count(void)
+{
+	long count = 1;
+
+#if defined(_SC_NPROCESSORS_ONLN)
+	count = sysconf(_SC_NPROCESSORS_ONLN);
+#elif defined(_SC_NPROC_ONLN)
+	/* IRIX */
+	count = sysconf(_SC_NPROC_ONLN);
+#endif
+
+	return (count < 1) ? 1 : (int)count;
+}
+
+/* exported function documented in motif/threadpool.h */
+nserror motif_pool_init(void)
+{
+	unsigned int idx;
+	int count;
+
+	count = nsoption_int(motif_worker_threads);
+	if (count < 0) {
+		NSLOG(netsurf, INFO, "Worker threads disabled");
+		return NSERROR_OK;
+	}
+	if (count == 0) {
+		count = pool_cpu_count();
+	}
+	if (count > POOL_MAX_WORKERS) {
+		count = POOL_MAX_WORKERS;
+	}
+
+	pool_workers = calloc(count, sizeof(struct pool_worker));
+	if (pool_workers == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	pool_quit = false;
+	for (idx = 0; idx < (unsigned int)count; idx++) {
+		struct pool_worker *worker = &pool_workers[idx];
+
+		pthread_mutex_init(&worker->lock, NULL);
+		worker->index = idx;
+		if (pthread_create(&worker->thread, NULL,
+				   pool_worker_main, worker) != 0) {
+			pthread_mutex_destroy(&worker->lock);
+			break;
+		}
+		/* workers steal from the published ones only */
+		__atomic_store_n(&pool_worker_count, idx + 1, __ATOMIC_RELEASE);
+	}
+
+	NSLOG(netsurf, INFO, "Started %u of %d worker threads",
+	      pool_worker_count, count);
+
+	if (pool_worker_count == 0) {
+		free(pool_workers);
+		pool_workers = NULL;
+		return NSERROR_INIT_FAILED;
+	}
+
+	return NSERROR_OK;
+}
+
+/* exported function documented in motif/threadpool.h */
+void motif_pool_fini(void)
+{
+	unsigned int idx;
+	unsigned int count = pool_worker_count;
+
+	if (count == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool_lock);
+	pool_quit = true;
+	pthread_cond_broadcast(&pool_work);
+	pthread_mutex_unlock(&pool_lock);
+
+	for (idx = 0; idx < count; idx++) {
+		pthread_join(pool_workers[idx].thread, NULL);
+	}
+
+	/* later submissions run inline */
+	pool_worker_count = 0;
+
+	for (idx = 0; idx < count; idx++) {
+		pthread_mutex_destroy(&pool_workers[idx].lock);
+	}
+	free(pool_workers);
+	pool_workers = NULL;
+}
+
+/* exported function documented in motif/threadpool.h */
+nserror motif_pool_submit(struct motif_token *token,
+			  void (*run)(void *pw),
+			  void (*done)(void *pw, bool cancelled),
+			  void *pw)
+{
+	struct motif_job *job;
+	struct pool_worker *worker;
+	unsigned int idx;
+
+	job = calloc(1, sizeof(struct motif_job));
+	if (job == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	job->token = motif_token_ref(token);
+	job->run = run;
+	job->done = done;
+	job->pw = pw;
+
+	pthread_mutex_lock(&pool_lock);
+	token->pending++;
+	pthread_mutex_unlock(&pool_lock);
+
+	if (pool_worker_count == 0) {
+		pool_execute(job);
+		return NSERROR_OK;
+	}
+
+	idx = __atomic_fetch_add(&pool_next, 1, __ATOMIC_RELAXED);
+	worker = &pool_workers[idx % pool_worker_count];
+
+	pthread_mutex_lock(&worker->lock);
+	job->prev = worker->tail;
+	if (worker->tail != NULL) {
+		worker->tail->next = job;
+	} else {
+		worker->head = job;
+	}
+	worker->tail = job;
+	pthread_mutex_unlock(&worker->lock);
+
+	__atomic_add_fetch(&pool_queued, 1, __ATOMIC_RELAXED);
+
+	pthread_mutex_lock(&pool_lock);
+	pthread_cond_signal(&pool_work);
+	pthread_mutex_unlock(&pool_lock);
+
+	return NSERROR_OK;
+}
+
+/* exported function documented in motif/threadpool.h */
+void motif_pool_wait(struct motif_token *token)
+{
+	struct motif_job *job;
+
+	for (;;) {
+		job = pool_take_token(token);
+		if (job != NULL) {
+			pool_execute(job);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool_lock);
+		if (token->pending == 0) {
+			pthread_mutex_unlock(&pool_lock);
+			break;
+		}
+		/* the remaining jobs are running on workers */
+		pthread_cond_wait(&pool_done, &pool_lock);
+		pthread_mutex_unlock(&pool_lock);
+	}
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset:8
+ * End:
+ */
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NETSURF_MOTIF_THREADPOOL_H
+#define NETSURF_MOTIF_THREADPOOL_H
+
+#include <stdbool.h>
+
+/**
+ * Cancellation token shared by the jobs of one owner.
+ *
+ * An object that hands work to the pool holds a token and passes it
+ * with every job. Cancelling the token stops queued jobs from running
+ * and waiting on it blocks until no job holding it is running.
+ */
+struct motif_token;
+
+/**
+ * Create a cancellation token with a single reference.
+ *
+ * \return The new token or NULL on memory exhaustion.
+ */
+struct motif_token *motif_token_create(void);
+
+/**
+ * Take an additional reference to a token.
+ *
+ * \param token The token to reference.
+ * \return The token.
+ */
+struct motif_token *motif_token_ref(struct motif_token *token);
+
+/**
+ * Release a reference to a token, freeing it with the last one.
+ *
+ * \param token The token to release.
+ */
+void motif_token_unref(struct motif_token *token);
+
+/**
+ * Cancel every job holding a token which has not yet started.
+ *
+ * \param token The token to cancel.
+ */
+void motif_token_cancel(struct motif_token *token);
+
+/**
+ * Check if a token has been cancelled.
+ *
+ * Long running jobs may poll this to stop early.
+ *
+ * \param token The token to check.
+ * \return true if the token has been cancelled.
+ */
+bool motif_token_cancelled(struct motif_token *token);
+
+/**
+ * Start the worker threads.
+ *
+ * The motif_worker_threads option gives the number of workers, zero
+ * selecting one per online processor. Without workers jobs are run
+ * by motif_pool_submit() itself.
+ *
+ * \return NSERROR_OK on success or error code on faliure.
+ */
+nserror motif_pool_init(void);
+
+/**
+ * Stop the worker threads once every queued job has run.
+ */
+void motif_pool_fini(void);
+
+/**
+ * Queue a job on the pool.
+ *
+ * The run function is called on a worker thread unless the token is
+ * cancelled first. The done function is always called afterwards from
+ * the scheduler on the Xt thread, with cancelled set if run was
+ * skipped, and is where pw should be released.
+ *
+ * \param token The token the job belongs to, referenced until done.
+ * \param run Function doing the work, must not call X or the core.
+ * \param done Function completing the job on the Xt thread.
+ * \param pw Private word passed to both functions.
+ * \return NSERROR_OK on success or NSERROR_NOMEM.
+ */
+nserror motif_pool_submit(struct motif_token *token,
+			  void (*run)(void *pw),
+			  void (*done)(void *pw, bool cancelled),
+			  void *pw);
+
+/**
+ * Wait until no job holding a token is queued or running.
+ *
+ * Queued jobs holding the token are run by the caller rather than
+ * waiting for a worker to reach them. Their done functions are still
+ * called later from the scheduler.
+ *
+ * \param token The token to wait for.
+ */
+void motif_pool_wait(struct motif_token *token);
+
+#endif
@@ -0,0 +1,383 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Rendered page tile cache.
+ *
+ * Windows drawn with the X11 plotters keep the page content they render
+ * in fixed size Pixmap tiles keyed by content coordinates, so areas
+ * scrolled back into view are copied rather than rendered again. Areas
+ * the core invalidates are rendered again into the tiles they touch
+ * when next drawn. The tiles of every window share one LRU list and
+ * the oldest are freed once the motif_tile_cache_size budget is
+ * exceeded.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "utils/log.h"
+#include "utils/nsoption.h"
+#include "netsurf/browser_window.h"
+#include "netsurf/plotters.h"
+
+#include <X11/Xlib.h>
+
+#include "motif/gui.h"
+#include "motif/drawing.h"
+#include "motif/tilecache.h"
+
+extern Display *motifDisplay;
+extern int motifDepth;
+
+/* tile edge in pixels */
+#define TILE_SIZE 256
+
+/* hash buckets per window */
+#define TILE_HASH_SIZE 64
+
+struct motif_tile {
+	struct motif_tile *hash_next;
+	struct motif_tile *lru_prev; /**< more recently used */
+	struct motif_tile *lru_next; /**< less recently used */
+	struct motif_tilecache *cache; /**< owning window cache */
+	int tx, ty; /**< position in units of TILE_SIZE */
+	Pixmap pixmap;
+	struct rect dirty; /**< tile area to render again, empty if x0 >= x1 */
+};
+
+struct motif_tilecache {
+	struct motif_tile *hash[TILE_HASH_SIZE];
+};
+
+static struct motif_tile *tile_lru_head = NULL;
+static struct motif_tile *tile_lru_tail = NULL;
+
+/* bytes of tiles held across every window */
+static size_t tile_bytes = 0;
+
+/**
+ * Tile index holding a content coordinate.
+ */
+static inline int tile_index(int v)
+{
+	return (v >= 0) ? (v / TILE_SIZE) : -((TILE_SIZE - 1 - v) / TILE_SIZE);
+}
+
+static inline unsigned int tile_hash(int tx, int ty)
+{
+	return ((unsigned int)tx * 31u + (unsigned int)ty) % TILE_HASH_SIZE;
+}
+
+/**
+ * Server memory used by one tile.
+ */
+static size_t tile_size(void)
+{
+	size_t bpp = (motifDepth > 16) ? 4 : (motifDepth > 8) ? 2 : 1;
+
+	return TILE_SIZE * TILE_SIZE * bpp;
+}
+
+static void tile_lru_unlink(struct motif_tile *tile)
+{
+	if (tile->lru_prev != NULL) {
+		tile->lru_prev->lru_next = tile->lru_next;
+	} else {
+		tile_lru_head = tile->lru_next;
+	}
+	if (tile->lru_next != NULL) {
+		tile->lru_next->lru_prev = tile->lru_prev;
+	} else {
+		tile_lru_tail = tile->lru_prev;
+	}
+	tile->lru_prev = tile->lru_next = NULL;
+}
+
+static void tile_lru_push(struct motif_tile *tile)
+{
+	tile->lru_prev = NULL;
+	tile->lru_next = tile_lru_head;
+	if (tile_lru_head != NULL) {
+		tile_lru_head->lru_prev = tile;
+	} else {
+		tile_lru_tail = tile;
+	}
+	tile_lru_head = tile;
+}
+
+/**
+ * Free a tile, removing it from its window and the LRU list.
+ */
+static void tile_free(struct motif_tile *tile)
+{
+	struct motif_tile **link;
+
+	link = &tile->cache->hash[tile_hash(tile->tx, tile->ty)];
+	while (*link != tile) {
+		link = &(*link)->hash_next;
+	}
+	*link = tile->hash_next;
+
+	tile_lru_unlink(tile);
+	XFreePixmap(motifDisplay, tile->pixmap);
+	tile_bytes -= tile_size();
+	free(tile);
+}
+
+static struct motif_tile *
+tile_find(struct motif_tilecache *cache, int tx, int ty)
+{
+	struct motif_tile *tile;
+
+	for (tile = cache->hash[tile_hash(tx, ty)];
+	     tile != NULL;
+	     tile = tile->hash_next) {
+		if ((tile->tx == tx) && (tile->ty == ty)) {
+			return tile;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Render part of a tile of content.
+ *
+ * \param tile The tile to render into.
+ * \param gw The window the tile belongs to.
+ * \param clip The area to render in tile coordinates.
+ */
+static void
+tile_paint(struct motif_tile *tile, struct gui_window *gw, const struct rect *clip)
+{
+	struct redraw_context ctx = {
+		.interactive = true,
+		.background_images = true,
+		.plot = &fb_plotters,
+		.priv = gw
+	};
+	Drawable previous;
+
+	previous = fb_plot_set_target(tile->pixmap);
+	browser_window_redraw(gw->bw,
+			      -tile->tx * TILE_SIZE,
+			      -tile->ty * TILE_SIZE,
+			      clip, &ctx);
+	fb_plot_set_target(previous);
+}
+
+/**
+ * Add an area to the part of a tile to render again.
+ *
+ * \param tile The tile.
+ * \param part The area in tile coordinates.
+ */
+static void tile_damage(struct motif_tile *tile, const struct rect *part)
+{
+	struct rect *dirty = &tile->dirty;
+
+	if (dirty->x0 >= dirty->x1) {
+		*dirty = *part;
+		return;
+	}
+	if (part->x0 < dirty->x0) {
+		dirty->x0 = part->x0;
+	}
+	if (part->y0 < dirty->y0) {
+		dirty->y0 = part->y0;
+	}
+	if (part->x1 > dirty->x1) {
+		dirty->x1 = part->x1;
+	}
+	if (part->y1 > dirty->y1) {
+		dirty->y1 = part->y1;
+	}
+}
+
+/**
+ * Render a tile of content, making room under the budget first.
+ *
+ * \return The new tile or NULL if it could not be kept.
+ */
+static struct motif_tile *
+tile_render(struct motif_tilecache *cache, struct gui_window *gw, int tx, int ty)
+{
+	struct rect clip = { 0, 0, TILE_SIZE, TILE_SIZE };
+	struct motif_tile *tile;
+	size_t size = tile_size();
+	size_t budget;
+	int kb;
+
+	kb = nsoption_int(motif_tile_cache_size);
+	budget = (kb > 0) ? ((size_t)kb * 1024) : 0;
+	if (size > budget) {
+		return NULL;
+	}
+
+	while ((tile_lru_tail != NULL) && ((tile_bytes + size) > budget)) {
+		tile_free(tile_lru_tail);
+	}
+
+	tile = calloc(1, sizeof(struct motif_tile));
+	if (tile == NULL) {
+		return NULL;
+	}
+
+	tile->pixmap = XCreatePixmap(motifDisplay, XtWindow(gw->drawingArea),
+				     TILE_SIZE, TILE_SIZE, motifDepth);
+	if (tile->pixmap == None) {
+		free(tile);
+		return NULL;
+	}
+	tile->cache = cache;
+	tile->tx = tx;
+	tile->ty = ty;
+
+	tile_paint(tile, gw, &clip);
+
+	tile->hash_next = cache->hash[tile_hash(tx, ty)];
+	cache->hash[tile_hash(tx, ty)] = tile;
+	tile_lru_push(tile);
+	tile_bytes += size;
+
+	return tile;
+}
+
+/* exported function documented in motif/tilecache.h */
+struct motif_tilecache *motif_tilecache_create(void)
+{
+	return calloc(1, sizeof(struct motif_tilecache));
+}
+
+/* exported function documented in motif/tilecache.h */
+void motif_tilecache_destroy(struct motif_tilecache *cache)
+{
+	motif_tilecache_invalidate(cache, NULL);
+	free(cache);
+}
+
+/* exported function documented in motif/tilecache.h */
+void motif_tilecache_invalidate(struct motif_tilecache *cache, const struct rect *rect)
+{
+	unsigned int bucket;
+
+	for (bucket = 0; bucket < TILE_HASH_SIZE; bucket++) {
+		struct motif_tile *tile = cache->hash[bucket];
+
+		while (tile != NULL) {
+			struct motif_tile *next = tile->hash_next;
+			int x0 = tile->tx * TILE_SIZE;
+			int y0 = tile->ty * TILE_SIZE;
+
+			if (rect == NULL) {
+				tile_free(tile);
+			} else if ((rect->x0 < (x0 + TILE_SIZE)) && (rect->x1 > x0) &&
+				   (rect->y0 < (y0 + TILE_SIZE)) && (rect->y1 > y0)) {
+				/* keep the tile, only the part covered changed */
+				struct rect part;
+
+				part.x0 = ((rect->x0 > x0) ? rect->x0 : x0) - x0;
+				part.y0 = ((rect->y0 > y0) ? rect->y0 : y0) - y0;
+				part.x1 = ((rect->x1 < (x0 + TILE_SIZE)) ? rect->x1 : (x0 + TILE_SIZE)) - x0;
+				part.y1 = ((rect->y1 < (y0 + TILE_SIZE)) ? rect->y1 : (y0 + TILE_SIZE)) - y0;
+				tile_damage(tile, &part);
+			}
+			tile = next;
+		}
+	}
+}
+
+/* exported function documented in motif/tilecache.h */
+void motif_tilecache_redraw(struct motif_tilecache *cache,
+			    struct gui_window *gw,
+			    Drawable target,
+			    int scrollX,
+			    int scrollY,
+			    const struct rect *clip)
+{
+	int cx0 = clip->x0 + scrollX;
+	int cy0 = clip->y0 + scrollY;
+	int cx1 = clip->x1 + scrollX;
+	int cy1 = clip->y1 + scrollY;
+	int tx, ty;
+
+	if ((cx1 <= cx0) || (cy1 <= cy0)) {
+		return;
+	}
+
+	for (ty = tile_index(cy0); ty <= tile_index(cy1 - 1); ty++) {
+		for (tx = tile_index(cx0); tx <= tile_index(cx1 - 1); tx++) {
+			struct motif_tile *tile;
+			int ox = tx * TILE_SIZE;
+			int oy = ty * TILE_SIZE;
+			int x0 = (cx0 > ox) ? cx0 : ox;
+			int y0 = (cy0 > oy) ? cy0 : oy;
+			int x1 = (cx1 < (ox + TILE_SIZE)) ? cx1 : (ox + TILE_SIZE);
+			int y1 = (cy1 < (oy + TILE_SIZE)) ? cy1 : (oy + TILE_SIZE);
+
+			tile = tile_find(cache, tx, ty);
+			if (tile != NULL) {
+				tile_lru_unlink(tile);
+				tile_lru_push(tile);
+				if (tile->dirty.x0 < tile->dirty.x1) {
+					struct rect dirty = tile->dirty;
+
+					tile->dirty.x1 = tile->dirty.x0;
+					tile_paint(tile, gw, &dirty);
+				}
+			} else {
+				tile = tile_render(cache, gw, tx, ty);
+			}
+
+			if (tile != NULL) {
+				/* rendering leaves a clip rectangle on the gc */
+				fb_plot_unclip(gw);
+				XCopyArea(motifDisplay, tile->pixmap, target, gw->gc,
+					  x0 - ox, y0 - oy,
+					  x1 - x0, y1 - y0,
+					  x0 - scrollX, y0 - scrollY);
+			} else {
+				/* over budget, render this part uncached */
+				struct redraw_context ctx = {
+					.interactive = true,
+					.background_images = true,
+					.plot = &fb_plotters,
+					.priv = gw
+				};
+				struct rect part = {
+					x0 - scrollX, y0 - scrollY,
+					x1 - scrollX, y1 - scrollY
+				};
+				Drawable previous;
+
+				previous = fb_plot_set_target(target);
+				browser_window_redraw(gw->bw,
+						      -scrollX, -scrollY,
+						      &part, &ctx);
+				fb_plot_set_target(previous);
+			}
+		}
+	}
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset:8
+ * End:
+ */
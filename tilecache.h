@@ -0,0 +1,77 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NETSURF_MOTIF_TILECACHE_H
+#define NETSURF_MOTIF_TILECACHE_H
+
+struct gui_window;
+struct rect;
+
+/**
+ * Rendered content tiles of one browser window.
+ */
+struct motif_tilecache;
+
+/**
+ * Create an empty tile cache for a window.
+ *
+ * \return The new cache or NULL on memory exhaustion.
+ */
+struct motif_tilecache *motif_tilecache_create(void);
+
+/**
+ * Free a tile cache and every tile in it.
+ *
+ * \param cache The cache to free.
+ */
+void motif_tilecache_destroy(struct motif_tilecache *cache);
+
+/**
+ * Mark an area of content as changed.
+ *
+ * The part of each tile the area covers is rendered again when the
+ * tile is next drawn. Tiles only touching the edge of the area are
+ * left alone.
+ *
+ * \param cache The cache to invalidate.
+ * \param rect Area in content coordinates or NULL to discard every tile.
+ */
+void motif_tilecache_invalidate(struct motif_tilecache *cache, const struct rect *rect);
+
+/**
+ * Redraw part of a window from its tiles.
+ *
+ * Missing tiles are rendered by the core and kept. When the cache
+ * budget cannot hold a tile that part is rendered straight into the
+ * target instead.
+ *
+ * \param cache The window's tile cache.
+ * \param gw The window being redrawn.
+ * \param target Drawable the window is being drawn into.
+ * \param scrollX Horizontal scroll offset of the window.
+ * \param scrollY Vertical scroll offset of the window.
+ * \param clip Area to redraw in window coordinates.
+ */
+void motif_tilecache_redraw(struct motif_tilecache *cache,
+			    struct gui_window *gw,
+			    Drawable target,
+			    int scrollX,
+			    int scrollY,
+			    const struct rect *clip);
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Main loop stall watchdog.
+ *
+ * The Xt thread leaves breadcrumbs around the work it dispatches. A
+ * separate thread checks how long the outermost breadcrumb has been
+ * held and reports it once it passes the threshold, signalling the
+ * Xt thread to print its own backtrace.
+ *
+ * Logging is not thread safe, so the report is written straight to
+ * stderr.
+ */
+
+/* dladdr() and Dl_info */
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <sys/time.h>
+
+#if defined(__sgi)
+#include <libexc.h>
+#elif defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+#include "utils/log.h"
+#include "utils/errors.h"
+#include "utils/nsoption.h"
+
+#include "motif/watchdog.h"
+
+/* breadcrumbs recorded, deeper nesting is only counted */
+#define WATCHDOG_DEPTH 8
+
+/* frames printed in a backtrace */
+#define WATCHDOG_FRAMES 64
+
+/**
+ * Breadcrumb left by the Xt thread.
+ */
+struct watchdog_crumb {
+	const char *kind;
+	const char *name;
+	void *fn;
+};
+
+static struct watchdog_crumb watchdog_stack[WATCHDOG_DEPTH];
+
+/* breadcrumbs held, written by the Xt thread only */
+static int watchdog_depth = 0;
+
+/* ms timestamp of the outermost breadcrumb */
+static uint32_t watchdog_start = 0;
+
+/* bumped on every outermost breadcrumb */
+static unsigned int watchdog_generation = 0;
+
+/* generation last reported as stalled */
+static unsigned int watchdog_reported = 0;
+
+static bool watchdog_enabled = false;
+static unsigned int watchdog_threshold;
+static pthread_t watchdog_main;
+static pthread_t watchdog_thread;
+static struct timeval watchdog_epoch;
+
+/**
+ * Milliseconds since the watchdog started, wrapping.
+ */
+static uint32_t watchdog_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	timersub(&tv, &watchdog_epoch, &tv);
+
+	return (uint32_t)((tv.tv_sec * 1000) + (tv.tv_usec / 1000));
+}
+
+/**
+ * Print a backtrace of the Xt thread from inside it.
+ *
+ * backtrace() was primed by motif_watchdog_init() so it no longer
+ * allocates, backtrace_symbols_fd() writes without allocating.
+ */
+static void watchdog_backtrace_signal(int sig)
+{
+#if defined(__sgi)
+	trace_back_stack_and_print();
+#elif defined(__GLIBC__)
+	void *frames[WATCHDOG_FRAMES];
+	int count;
+
+	count = backtrace(frames, WATCHDOG_FRAMES);
+	backtrace_symbols_fd(frames, count, STDERR_FILENO);
+#endif
+}
+
+/**
+ * Write a line to stderr from the watchdog thread.
+ */
+static void watchdog_write(const char *fmt, ...)
+{
+	char line[256];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+	va_end(ap);
+
+	if (len < 0) {
+		return;
+	}
+	if (len > (int)sizeof(line) - 2) {
+		len = sizeof(line) - 2;
+	}
+	line[len++] = '\n';
+
+	if (write(STDERR_FILENO, line, len) < 0) {
+		/* nowhere left to report to */
+	}
+}
+
+/**
+ * Report the breadcrumbs held by a stalled Xt thread.
+ */
+static void watchdog_report(int depth, uint32_t elapsed)
+{
+	int idx;
+
+	watchdog_write("Main loop stalled for %ums", elapsed);
+
+	for (idx = 0; (idx < depth) && (idx < WATCHDOG_DEPTH); idx++) {
+		struct watchdog_crumb *crumb = &watchdog_stack[idx];
+		const char *kind;
+		const char *name;
+		void *fn;
+		Dl_info info;
+
+		kind = __atomic_load_n(&crumb->kind, __ATOMIC_RELAXED);
+		name = __atomic_load_n(&crumb->name, __ATOMIC_RELAXED);
+		fn = __atomic_load_n(&crumb->fn, __ATOMIC_RELAXED);
+
+		if ((name == NULL) && (fn != NULL) &&
+		    (dladdr(fn, &info) != 0) &&
+		    (info.dli_saddr == fn)) {
+			name = info.dli_sname;
+		}
+
+		watchdog_write("  in %s %s (%p)", kind,
+			       (name != NULL) ? name : "?", fn);
+	}
+	if (depth > WATCHDOG_DEPTH) {
+		watchdog_write("  and %d more", depth - WATCHDOG_DEPTH);
+	}
+}
+
+static void *watchdog_main_loop(void *arg)
+{
+	unsigned int period;
+
+	/* check often enough to notice a stall soon after the threshold */
+	period = (watchdog_threshold * 1000) / 2;
+	if (period < 10000) {
+		period = 10000;
+	}
+
+	for (;;) {
+		unsigned int generation;
+		uint32_t elapsed;
+		int depth;
+
+		usleep(period);
+
+		generation = __atomic_load_n(&watchdog_generation,
+					     __ATOMIC_ACQUIRE);
+		depth = __atomic_load_n(&watchdog_depth, __ATOMIC_ACQUIRE);
+		if ((depth == 0) ||
+		    (generation == __atomic_load_n(&watchdog_reported,
+						   __ATOMIC_RELAXED))) {
+			continue;
+		}
+
+		elapsed = watchdog_now() -
+			__atomic_load_n(&watchdog_start, __ATOMIC_RELAXED);
+		if ((elapsed < watchdog_threshold) ||
+		    (generation != __atomic_load_n(&watchdog_generation,
+						   __ATOMIC_ACQUIRE))) {
+			continue;
+		}
+
+		__atomic_store_n(&watchdog_reported, generation,
+				 __ATOMIC_RELAXED);
+		watchdog_report(depth, elapsed);
+		pthread_kill(watchdog_main, SIGUSR2);
+	}
+
+	return NULL;
+}
+
+/* exported function documented in motif/watchdog.h */
+nserror motif_watchdog_init(void)
+{
+	struct sigaction sa;
+	int threshold;
+#if defined(__GLIBC__)
+	void *frame;
+#endif
+
+	threshold = nsoption_int(motif_watchdog_ms);
+	if (threshold <= 0) {
+		return NSERROR_OK;
+	}
+
+	watchdog_threshold = threshold;
+	watchdog_main = pthread_self();
+	gettimeofday(&watchdog_epoch, NULL);
+
+#if defined(__GLIBC__)
+	/* the first backtrace() loads the unwinder, which allocates */
+	backtrace(&frame, 1);
+#endif
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = watchdog_backtrace_signal;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR2, &sa, NULL);
+
+	if (pthread_create(&watchdog_thread, NULL,
+			   watchdog_main_loop, NULL) != 0) {
+		NSLOG(netsurf, INFO, "Unable to start watchdog thread");
+		return NSERROR_INIT_FAILED;
+	}
+	pthread_detach(watchdog_thread);
+
+	watchdog_enabled = true;
+
+	return NSERROR_OK;
+}
+
+/* exported function documented in motif/watchdog.h */
+void motif_watchdog_enter(const char *kind, const char *name, void *fn)
+{
+	int depth = watchdog_depth;
+
+	if (!watchdog_enabled) {
+		return;
+	}
+
+	if (depth < WATCHDOG_DEPTH) {
+		struct watchdog_crumb *crumb = &watchdog_stack[depth];
+		__atomic_store_n(&crumb->kind, kind, __ATOMIC_RELAXED);
+		__atomic_store_n(&crumb->name, name, __ATOMIC_RELAXED);
+		__atomic_store_n(&crumb->fn, fn, __ATOMIC_RELAXED);
+	}
+
+	if (depth == 0) {
+		__atomic_store_n(&watchdog_start, watchdog_now(),
+				 __ATOMIC_RELAXED);
+		__atomic_add_fetch(&watchdog_generation, 1, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(&watchdog_depth, depth + 1, __ATOMIC_RELEASE);
+}
+
+/* exported function documented in motif/watchdog.h */
+void motif_watchdog_leave(void)
+{
+	int depth = watchdog_depth - 1;
+
+	if (!watchdog_enabled || (depth < 0)) {
+		return;
+	}
+
+	__atomic_store_n(&watchdog_depth, depth, __ATOMIC_RELEASE);
+
+	if ((depth == 0) &&
+	    (__atomic_load_n(&watchdog_reported, __ATOMIC_RELAXED) ==
+	     __atomic_load_n(&watchdog_generation, __ATOMIC_RELAXED))) {
+		NSLOG(netsurf, WARNING, "Main loop stall ended after %ums",
+		      watchdog_now() - watchdog_start);
+	}
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset:8
+ * End:
+ */
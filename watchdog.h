@@ -0,0 +1,50 @@
+/*
+ * Copyright 2008 Vincent Sanders <vince@simtec.co.uk>
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NETSURF_MOTIF_WATCHDOG_H
+#define NETSURF_MOTIF_WATCHDOG_H
+
+/**
+ * Start the stall watchdog thread.
+ *
+ * Must be called from the Xt thread. The motif_watchdog_ms option
+ * gives the stall threshold, zero disables the watchdog.
+ *
+ * \return NSERROR_OK on success or error code on faliure.
+ */
+nserror motif_watchdog_init(void);
+
+/**
+ * Leave a breadcrumb on entry to work dispatched from the main loop.
+ *
+ * Breadcrumbs nest. When the outermost one has been held for longer
+ * than the threshold the watchdog logs every breadcrumb held, the
+ * stall duration and a backtrace of the Xt thread.
+ *
+ * \param kind What sort of entry point this is.
+ * \param name Name of the entry point or NULL to resolve fn.
+ * \param fn Address of the entry point or NULL.
+ */
+void motif_watchdog_enter(const char *kind, const char *name, void *fn);
+
+/**
+ * Remove the most recent breadcrumb.
+ */
+void motif_watchdog_leave(void);
+
+#endif